@@ -0,0 +1,138 @@
+#!/usr/bin/env python
+# Estimates what a patch costs on the Magus's Cortex-M core rather than on this computer.
+# Cross-compiles the patch with MakeMagusSim.py --target, runs it under qemu-arm with the
+# cortexm/blockCount.c plugin, and reports instructions and estimated cycles per processAudio
+# call, along with how much of that went to software double-precision, fmodf and other libm.
+# Needs arm-none-eabi-gcc, qemu-arm with plugin support and its qemu-plugin.h, and glib.
+# License https://creativecommons.org/publicdomain/zero/1.0/
+
+import sys
+import os
+import os.path
+import re
+import csv
+import shutil
+import tempfile
+import subprocess
+try:
+    import click
+except ImportError:
+    sys.stderr.write("Error: \"Click\" module missing. Run `pip install click`\n")
+    sys.exit(1)
+
+simDir = os.path.dirname(os.path.abspath(__file__))
+
+# Functions whose share of the instructions is worth calling out, by group
+softDouble = re.compile(r'^(__aeabi_[dfilu]+2d|__aeabi_d\w+|__\w*df\w*)$') # Software double-precision helpers
+libm = re.compile(r'^(fmodf?|sinf?|cosf?|tanf?|expf?|exp2f?|logf?|log2f?|log10f?|powf?|sqrtf?|floorf?|ceilf?|roundf?|truncf?|atan2?f?|__ieee754_\w+|__kernel_\w+)$')
+
+def groupOf(name):
+    if softDouble.match(name):
+        return "soft double"
+    if name in ("fmodf", "fmod", "__ieee754_fmodf", "__ieee754_fmod"):
+        return "fmod"
+    if libm.match(name):
+        return "other libm"
+    return None
+
+# Symbols as {name: (address, size)} from nm
+def symbols(nm, elf):
+    found = {}
+    text = subprocess.check_output([nm, "-S", "--defined-only", elf]).decode("utf-8", "replace")
+    for line in text.splitlines():
+        parts = line.split()
+        if len(parts) == 4 and parts[2] in "tTwW":
+            found[parts[3]] = (int(parts[0], 16), int(parts[1], 16))
+        elif len(parts) == 3 and parts[1] in "tTwW": # No size
+            found[parts[2]] = (int(parts[0], 16), 0)
+    return found
+
+@click.command(help="Runs one patch under qemu-arm and estimates its instructions and Cortex-M cycles per processAudio call. The defaults match the Magus's STM32F427, a Cortex-M4 at 168 MHz. Cycles come from a single-issue per-instruction model with no caches, which suits the M4; on a Cortex-M7, which dual-issues and predicts branches, it overestimates.")
+@click.argument('infile')
+@click.option('--include', '-i', multiple=True, type=click.STRING, help="Passed on to MakeMagusSim.py --include")
+@click.option('--cpu', default="cortex-m4", type=click.Choice(["cortex-m4", "cortex-m7"]), help="Core to compile for and emulate (default cortex-m4, as on the Magus)")
+@click.option('--mhz', default=168.0, type=click.FLOAT, help="Core clock, for the share of the real-time budget (default 168, the Magus's; set it to match --cpu)")
+@click.option('--blocks', default=50, type=click.INT, help="processAudio calls to run (default 50)")
+@click.option('--block-size', '-b', default=64, type=click.INT, help="Samples per block (default 64)")
+@click.option('--sample-rate', '-r', default=48000.0, type=click.FLOAT, help="Sample rate (default 48000)")
+@click.option('--cxx', envvar='ARM_CXX', default="arm-none-eabi-g++", help="(Or env var ARM_CXX) Cross compiler")
+@click.option('--cxxflags', default="-O2", help="Flags for the cross compiler (default -O2)")
+@click.option('--nm', default="arm-none-eabi-nm", help="nm for the cross toolchain")
+@click.option('--qemu', default="qemu-arm", help="qemu user-mode emulator")
+@click.option('--qemu-include', envvar='QEMU_PLUGIN_INCLUDE', help="(Or env var QEMU_PLUGIN_INCLUDE) Directory holding qemu-plugin.h, if not on the include path")
+@click.option('--cc', envvar='CC', default="cc", help="(Or env var CC) Host C compiler for the plugin")
+@click.option('--csv', 'csvPath', help="Also write the counts for every block to this CSV file")
+def estimate(infile, include, cpu, mhz, blocks, block_size, sample_rate, cxx, cxxflags, nm, qemu, qemu_include, cc, csvPath):
+    workDir = tempfile.mkdtemp()
+    try:
+        elf = os.path.join(workDir, "patch.elf")
+        command = [sys.executable, os.path.join(simDir, "MakeMagusSim.py"), infile, "--target", cpu,
+            "--cxx", cxx, "--cxxflags", cxxflags, "-o", elf]
+        for i in include:
+            command += ["-i", i]
+        if subprocess.call(command):
+            raise click.ClickException("Cross compile failed")
+
+        plugin = os.path.join(workDir, "libblockcount.so")
+        try:
+            glib = subprocess.check_output(["pkg-config", "--cflags", "--libs", "glib-2.0"]).decode("utf-8").split()
+        except (OSError, subprocess.CalledProcessError):
+            raise click.ClickException("Couldn't find glib-2.0 with pkg-config; the plugin needs its headers")
+        command = [cc, "-shared", "-fPIC", "-O2", "-std=gnu99", os.path.join(simDir, "cortexm", "blockCount.c"), "-o", plugin] + glib
+        if qemu_include:
+            command += ["-I", qemu_include]
+        if subprocess.call(command):
+            raise click.ClickException("Couldn't build the QEMU plugin")
+
+        found = symbols(nm, elf)
+        for name in ("simBlockStart", "simBlockEnd"):
+            if name not in found:
+                raise click.ClickException("No %s in %s" % (name, elf))
+        watched = sorted(name for name in found if groupOf(name) and found[name][1] > 0)
+        out = os.path.join(workDir, "counts.csv")
+        pluginArgs = ["start=0x%x" % found["simBlockStart"][0], "end=0x%x" % found["simBlockEnd"][0], "out=" + out]
+        pluginArgs += ["fn=%s:0x%x:%d" % (name, found[name][0], found[name][1]) for name in watched]
+        command = [qemu, "-cpu", cpu, "-plugin", plugin + "," + ",".join(pluginArgs), elf,
+            str(blocks), str(block_size), str(sample_rate)]
+        try:
+            if subprocess.call(command, cwd=workDir):
+                raise click.ClickException("Patch failed under " + qemu)
+        except OSError:
+            raise click.ClickException("Couldn't run " + qemu)
+
+        with open(out) as f:
+            rows = list(csv.DictReader(f))
+        if len(rows) < 2:
+            raise click.ClickException("The plugin recorded no blocks")
+        if csvPath:
+            shutil.copy(out, csvPath)
+        constructor, rows = rows[0], rows[1:]
+
+        insns = [int(r["insns"]) for r in rows]
+        cycles = [float(r["cycles"]) for r in rows]
+        budget = mhz * 1e6 * block_size / sample_rate
+        print("%s on %s at %g MHz, %d blocks of %d at %g Hz (budget %.0f cycles per block)" %
+            (os.path.basename(infile), cpu, mhz, len(rows), block_size, sample_rate, budget))
+        print("  constructor   %12d instructions" % int(constructor["insns"]))
+        print("  instructions  mean %10.0f  max %10d  per sample %8.1f" % (sum(insns)/float(len(insns)), max(insns), sum(insns)/float(len(insns))/block_size))
+        print("  est. cycles   mean %10.0f  max %10.0f  per sample %8.1f  (%.1f%% of budget at worst)" %
+            (sum(cycles)/len(cycles), max(cycles), sum(cycles)/len(cycles)/block_size, 100*max(cycles)/budget))
+        print("  divides and square roots per block: %.1f" % (sum(int(r["divides"]) for r in rows)/float(len(rows))))
+
+        total = float(sum(insns))
+        groups = {}
+        for name in watched:
+            count = sum(int(r[name]) for r in rows)
+            if count:
+                groups.setdefault(groupOf(name), []).append((count, name))
+        for group in ("soft double", "fmod", "other libm"):
+            if group in groups:
+                count = sum(c for c, n in groups[group])
+                top = ", ".join("%s %.1f%%" % (n, 100*c/total) for c, n in sorted(groups[group], reverse=True)[:4])
+                print("  %-12s %5.1f%% of instructions (%s)" % (group + ":", 100*count/total, top))
+        if not groups:
+            print("  No time in software double-precision, fmodf or other libm functions")
+    finally:
+        shutil.rmtree(workDir)
+
+estimate()
@@ -11,12 +11,19 @@ import os
 import os.path
 import tempfile
 import subprocess
+import shlex
+import hashlib
+import multiprocessing
+from multiprocessing.pool import ThreadPool
 try:
     import click
 except ImportError:
     sys.stderr.write("Error: \"Click\" module missing. Run `pip install click`\n")
     sys.exit(1)
 
+# Directory containing this script and the driver/ and fakes/ support headers
+simDir = os.path.dirname(os.path.abspath(__file__))
+
 # Convert "/path/to/file/filename.ext" to "filename"
 chopdot = re.compile(r'^[^\.]+')
 def innerName(s):
@@ -47,35 +54,82 @@ def prepUnpackPair(pair, buildDir):
     d = buildDir
   return d, filename
 
-@click.command(help="Processes an hpp file into a standalone executable simulating running on the Magus")
-@click.argument('infile')
-@click.option('--class', '-c', '_class', type=click.STRING, help="Name of main class (if different from infile name)")
-@click.option('--output', '-o', type=click.STRING, help="Output file        (if different from infile name)")
+# Cache directory for compiled simulators, by default under the user's cache home
+def defaultCacheDir():
+  base = os.environ.get("XDG_CACHE_HOME") or os.path.join(os.path.expanduser("~"), ".cache")
+  return os.path.join(base, "MagusSim")
+
+def makedirs(d):
+  try:
+    os.makedirs(d)
+  except OSError:
+    if not os.path.isdir(d):
+      raise
+
+# sha1 over labeled byte strings; labels keep ("ab","c") and ("a","bc") apart
+def hashParts(parts):
+  h = hashlib.sha1()
+  for label, data in parts:
+    if not isinstance(data, bytes):
+      data = data.encode("utf-8")
+    h.update(("%s %d\n" % (label, len(data))).encode("utf-8"))
+    h.update(data)
+  return h.hexdigest()
+
+def fileBytes(path):
+  with open(path, "rb") as f:
+    return f.read()
+
+# Every file under root as (relative path, contents), in a stable order
+def treeParts(root, skip=lambda rel: False):
+  parts = []
+  for d, dirs, files in os.walk(root):
+    dirs.sort()
+    for name in sorted(files):
+      path = os.path.join(d, name)
+      rel = os.path.relpath(path, root).replace(os.sep, "/")
+      if not skip(rel):
+        parts.append((rel, fileBytes(path)))
+  return parts
+
+# Copy into the cache under a temporary name and rename, so concurrent builds never see half a file
+def cacheStore(source, dest):
+  temp = "%s.%d.tmp" % (dest, os.getpid())
+  shutil.copy2(source, temp)
+  os.rename(temp, dest)
+
+@click.command(help="Processes hpp files into a standalone executable simulating running on the Magus. Given several, builds one executable containing all of them; choose one at runtime with --patch.")
+@click.argument('infiles', nargs=-1, required=True)
+@click.option('--class', '-c', '_class', type=click.STRING, help="Name of main class (if different from infile name; only with one infile)")
+@click.option('--output', '-o', type=click.STRING, help="Output file        (if different from infile name; \"magussim\" for several infiles)")
 @click.option('--include', '-i', multiple=True, type=click.STRING, help="Copy this file into build directory (Note: If a destination directory is needed, prefix with :\nEG --include \"support:support/file.h\"")
 @click.option('--note', '-n', multiple=True, type=click.STRING, help="Play MIDI note into program. Syntax 69 for note 69 on at start, 100:69 or 100:69:1 for note 69 on at sample 100, or 200:69:0 for note 69 off at sample 200.")
 @click.option('--cxx', envvar='CXX', default="c++", type=click.STRING, help="(Or env var CXX) C++ compiler to use")
-def make(infile, _class, cxx, output, include, note):
-    # Clean up arguments, make all paths absolute except infile
-    defaultName = innerName(infile)
-    if not defaultName:
-        raise click.ClickException("INFILE appears to be a directory?")
-    if not _class:
-        _class = defaultName
+@click.option('--cxxflags', envvar='CXXFLAGS', default="-O2", type=click.STRING, help="(Or env var CXXFLAGS) Flags to pass the C++ compiler")
+@click.option('--cache-dir', envvar='MAGUSSIM_CACHE', type=click.STRING, help="(Or env var MAGUSSIM_CACHE) Where to keep compiled simulators (default $XDG_CACHE_HOME/MagusSim)")
+@click.option('--no-cache', is_flag=True, help="Always compile, and don't store the result")
+@click.option('--target', default="host", type=click.Choice(["host", "cortex-m7", "cortex-m4"]), help="Build the simulator for this computer (default), or a bare-metal ELF of one patch for CortexMagusSim.py to run under qemu-arm")
+def make(infiles, _class, cxx, cxxflags, output, include, note, cache_dir, no_cache, target):
+    # Clean up arguments, make all paths absolute except infiles
+    if _class and len(infiles) > 1:
+        raise click.ClickException("--class can only be used with a single INFILE")
+    if target != "host" and len(infiles) > 1:
+        raise click.ClickException("--target "+target+" builds a single INFILE")
+    patches = [] # [class, file] for each infile
+    for infile in infiles:
+        defaultName = innerName(infile)
+        if not defaultName:
+            raise click.ClickException(infile+" appears to be a directory?")
+        if any(defaultName == p[0] for p in patches):
+            raise click.ClickException("More than one INFILE is named "+defaultName)
+        patches.append([_class or defaultName, os.path.basename(infile)])
     if not output:
-        output = os.path.abspath(defaultName)
-    include = [includeSplit(x) for x in ([infile] + list(include))]
-    infile = os.path.basename(infile)
-    sampleRate = 44100
-    # print(infile, _class, cxx, output, include) # Debug
-
-    # Copy files into temp dir
-    # TODO: Some method for copying files to subdirs
-    buildDir = tempfile.mkdtemp()
-    print("Building in directory "+buildDir)
-    os.chdir(buildDir)
-    for pair in include:
-      d, filename = prepUnpackPair(pair, buildDir)
-      shutil.copy(filename, d)
+        output = len(infiles) == 1 and innerName(infiles[0]) or "magussim"
+    output = os.path.abspath(output)
+    include = [includeSplit(x) for x in (list(infiles) + list(include))]
+    sampleRate = 44100 # Defaults for the generated program, which can override them at runtime
+    blockSize = 1024
+    # print(patches, cxx, output, include) # Debug
 
     notes = []
     if note:
@@ -90,23 +144,74 @@ def make(infile, _class, cxx, output, include, note):
         else:
           raise click.ClickException("Don't understand "+_n)
         notes.append([at, [on and 9 or 8, on and 0x90 or 0x80, n & 0x7F, on and 0x7F or 0]])
+      notes.sort(key=lambda n: n[0]) # Driver consumes events in time order (stable, so ties keep command line order)
+
+    # Generated sources, by name in the build directory. Written out by stage() below.
+    generated = {}
 
     # Create include file
-    with open("__SIM_INCLUDE.h", "w") as f:
-        f.write("""
+    generated["__SIM_INCLUDE.h"] = ("""
 #ifndef ____SIM_INCLUDE
 #define ____SIM_INCLUDE
 
 // Miniature, wildly incorrect implementation of openware/OwlProgram classes
 // TODO: Pull in more code from actual openware/OwlProgram repos?
 
-#import <algorithm>
-#import <vector>
-using std::min;
-using std::max;
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <vector>
+#ifndef SIM_BARE_METAL
+#include <chrono>
+#endif
+
+// basicmaths.h on the device makes min/max macros, so patches freely mix float and double
+template<typename A, typename B> inline auto min(A a, B b) -> decltype(a+b) {{ return a < b ? a : b; }}
+template<typename A, typename B> inline auto max(A a, B b) -> decltype(a+b) {{ return a > b ? a : b; }}
 
 #define OWL_SIMULATOR 1
 
+#ifdef SIM_BARE_METAL // Cortex-M builds run one patch on one thread
+#define SIM_THREAD_LOCAL
+#else
+#define SIM_THREAD_LOCAL thread_local
+#endif
+
+class MidiMessage;
+void _simSendMidi(MidiMessage msg); // Driver logs these
+
+// Counters behind support/profile.h. The driver keeps a list of them for the --bench report.
+struct SimProfileSection {{
+    const char *name;
+    uint64_t ticks;
+    uint32_t calls;
+    uint32_t maxTicks;
+    SimProfileSection *next;
+}};
+void _simProfileRegister(SimProfileSection *section);
+// Sections are plain globals shared by every thread, so only threads with this set record
+// into them. Sweep workers, which run the same patch on many threads at once, clear it.
+extern SIM_THREAD_LOCAL bool _simProfiling;
+static inline uint64_t _simProfileNow() {{ // Cheapest clock available; the driver converts to ns
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#elif defined(SIM_BARE_METAL)
+    return 0; // No clock; sections only count calls
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}}
+
+// Set by the driver from the command line before the patch is constructed.
+// _simBlockSize is the size of the block currently being processed, which is smaller
+// than the configured block size when the driver splits a block at a MIDI event.
+// It is per thread because sweeps run many patches at once.
+extern float _simSampleRate;
+extern SIM_THREAD_LOCAL int _simBlockSize;
+
 // Enum copied from Openware repo, git:76c941b2e7b2, OpenWareMidiControl.h
 enum PatchParameterId {{
   PARAMETER_A,
@@ -173,49 +278,33 @@ enum PatchButtonId {{
   MIDI_NOTE_BUTTON = 0x80 // "values over 127 are mapped to note numbers"
 }};
 
-struct Patch {{
-    std::vector<float> _parameters;
-    void registerParameter(PatchParameterId _id, const char *) {{
-        int need = (int)_id + 1;
-        if (_parameters.size() <= need) _parameters.resize(need);
-    }}
-    float getParameterValue(PatchParameterId id) {{ return _parameters[(int)id]; }} // TODO
-    void  setParameterValue(PatchParameterId id, float v) {{ _parameters[(int)id] = v; }}     // TODO
-    float getSampleRate() {{ return {sampleRate}; }}
-}};
-
-struct MonochromePatch : public Patch {{
-}};
-
-struct FloatArray {{
-    size_t _size;
-    float *_data;
-    void _clear() {{
-        memset(_data, 0, _size);
-    }}
-
-    float *getData() {{ return _data; }}
-    size_t getSize() {{ return _size; }}
-}};
+#include "FloatArray.h"
 
 #define LEFT_CHANNEL 0
 #define RIGHT_CHANNEL 1
 
 struct AudioBuffer {{
     FloatArray _left, _right;
+    float *_leftStorage, *_rightStorage;
     void _clear() {{
         _left._clear();
         _right._clear();
     }}
+    // Point the channels at a sub-range of the storage (used to split a frame at MIDI events)
+    void _window(size_t offset, size_t size) {{
+        _left._data = _leftStorage + offset;
+        _left._size = size;
+        _right._data = _rightStorage + offset;
+        _right._size = size;
+    }}
     AudioBuffer(size_t capacity) {{
-        _left._data = (float *)malloc(capacity*sizeof(float));
-        _left._size = capacity;
-        _right._data = (float *)malloc(capacity*sizeof(float));
-        _right._size = capacity;
+        _leftStorage = (float *)FloatArray::_allocate(capacity*sizeof(float));
+        _rightStorage = (float *)FloatArray::_allocate(capacity*sizeof(float));
+        _window(0, capacity);
     }}
     ~AudioBuffer() {{
-        free(_left._data);
-        free(_right._data);
+        FloatArray::_free(_leftStorage);
+        FloatArray::_free(_rightStorage);
     }}
 
     FloatArray getSamples(int idx) {{
@@ -389,36 +478,126 @@ class MidiMessage {{
   }}
 }};
 
+#include "Resource.h"
+
+// The driver calls processMidi on every patch, so the base class needs a do-nothing default
+struct Patch {{
+    virtual ~Patch() {{}}
+    std::vector<float> _parameters;
+    void registerParameter(PatchParameterId _id, const char *) {{
+        int need = (int)_id + 1;
+        if (_parameters.size() <= need) _parameters.resize(need);
+    }}
+    float getParameterValue(PatchParameterId id) {{ return _parameters[(int)id]; }} // TODO
+    void  setParameterValue(PatchParameterId id, float v) {{ _parameters[(int)id] = v; }}     // TODO
+    float getSampleRate() {{ return _simSampleRate; }}
+    int getBlockSize() {{ return _simBlockSize; }}
+    void sendMidi(MidiMessage msg) {{ _simSendMidi(msg); }}
+    Resource *getResource(const char *name) {{ return Resource::load(name); }}
+
+    virtual void processAudio(AudioBuffer &buffer) = 0;
+    virtual void processMidi(MidiMessage msg) {{}}
+    virtual void buttonChanged(PatchButtonId bid, uint16_t value, uint16_t samples) {{}}
+
+    // Simulator only: describe anything wrong with the patch's state, or NULL. Checked after every message under --stress.
+    virtual const char *_simCheckInvariants() {{ return NULL; }}
+}};
+
+struct MonochromePatch : public Patch {{
+}};
+
+#include "MonochromeScreenBuffer.h"
+
+// The driver draws into a MonochromeScreenBuffer at --screen-rate and calls this
+struct MonochromeScreenPatch : public Patch {{
+    virtual void processScreen(MonochromeScreenBuffer &screen) {{}}
+}};
+
 #endif
 
-""".format(sampleRate=sampleRate))
+""".format())
 
     # Create include file forwards
     # TODO: Make a fuller list, make a command line arg
-    forwardIncludes = ["OpenWareMidiControl.h", "StompBox.h"]
+    forwardIncludes = ["OpenWareMidiControl.h", "StompBox.h", "MonochromeScreenPatch.h"]
     for name in forwardIncludes:
-        with open(name, "w") as f:
-            f.write("""
+        generated[name] = ("""
 #include "__SIM_INCLUDE.h"
 """)
 
+    # Create one translation unit per patch, each registering itself with the driver
+    patchSources = []
+    for _class, infile in patches:
+        source = "__patch_" + _class + ".cpp"
+        generated[source] = ("""
+#include "__SIM_INCLUDE.h"
+#include "driver/registry.h"
+#include "{infile}"
+
+SIM_REGISTER_PATCH({_class}, "{infile}")
+""".format(infile=infile, _class=_class))
+        patchSources.append(source)
+
     # Create driver file
-    # TODO: Take input values for knobs
-    # TODO: Take sample rate value
-    # TODO: Emit a wav header?
-    with open("__driver.cpp", "w") as f:
-        f.write("""
+    # Knobs are set over time by --automation and per point by --sweep; a fixed value needs a one-row automation file
+    generated["__driver.cpp"] = ("""
 #include <string>
 #include <vector>
 #include <algorithm>
+#include <mutex>
+#include "driver/benchmark.h"
+#include "driver/midiFile.h"
+#include "driver/wavFile.h"
+#include "driver/audioInput.h"
+#include "driver/automation.h"
+#include "driver/midiOut.h"
+#include "driver/registry.h"
+#include "driver/render.h"
+#include "driver/sweep.h"
+#include "driver/heap.h"
+#include "driver/realtime.h"
+#include "driver/midiIn.h"
+#include "driver/midiStress.h"
+#include "driver/digest.h"
+#include "driver/chain.h"
+#include "driver/perfCounters.h"
 
 const char *explanation =
-    "Generates a number of samples from {_class} ({infile}) and prints them to stdout as interleaved float samples. To open, try import raw data feature in Amadeus or Audacity.";
+    "Generates a number of samples from a patch and prints them to stdout as interleaved float samples. To open, try import raw data feature in Amadeus or Audacity.";
 
 const char *usage =
     "Usage: %s [OPTIONS]\\n\\n"
-    "-s, --samples: Number of samples (default {sampleRate})\\n"
+    "-p, --patch: Patch to run, by class name with or without \\"Patch\\" (default the only one built in). Give several, comma separated, to run them in series on the same buffer, eg Saw4,PureDelay\\n"
+    "--midi-all-stages: With several patches, send MIDI to every one rather than only the first\\n"
+    "--list: List the patches built in\\n"
+    "-s, --samples: Number of samples (default one second)\\n"
+    "-r, --sample-rate: Sample rate reported to the patch (default {sampleRate})\\n"
+    "-b, --block-size: Samples per processAudio call (default {blockSize})\\n"
+    "-i, --input: Stream a WAV file into the patch's audio input (default silence)\\n"
+    "-a, --automation: Move knobs/CV and press buttons from a CSV file of time,parameter,value breakpoints\\n"
+    "-m, --midi: Play a standard MIDI file into the patch (may be given more than once)\\n"
+    "--midi-in: Also take MIDI live from this FIFO, Unix socket or file, delivered at the start of the next block\\n"
+    "--midi-in-usb: --midi-in carries 4-byte USB-MIDI packets rather than raw MIDI bytes\\n"
+    "--stress: Add a MIDI storm: notes, overflow, duplicates, cc or ccall, with an optional rate in events per second, eg notes:5000 (may be given more than once). Times each message and checks the patch's invariants after it\\n"
+    "--stress-seed: Seed for --stress (default 1)\\n"
     "-h, --human: Print human readable instead of machine samples\\n"
+    "-w, --wav: Write a WAV file to this path instead of printing samples\\n"
+    "--wav-format: Sample format for --wav: float, 16 or 24 (default float)\\n"
+    "--screen-rate: Times per second to call processScreen, 0 for never (default 20)\\n"
+    "--screen-dump: Save each screen frame as a PBM image named with this prefix\\n"
+    "--resources: Directory that getResource() loads from (default current directory)\\n"
+    "--midi-out: Write everything the patch sends with sendMidi to this MIDI file\\n"
+    "--bench: Discard output and print timing for each block against the real-time budget, and a latency histogram for each kind of patch callback, then the patch's memory use\\n"
+    "--digest: Discard output and print only a hash of it with its peak and RMS level, for comparing renders quickly\\n"
+    "--counters: Count CPU cycles, instructions, L1 data cache misses and branch misses in each processAudio and processMidi call with perf_event_open, and print them per call and per sample\\n"
+    "--realtime: Produce blocks no faster than the sample rate, as the device would, and count each block that misses its deadline as an xrun\\n"
+    "--worst: Number of slowest blocks --bench lists with their sample offsets (default 5)\\n"
+    "--sweep: Render once per value of a parameter instead, eg A=0:1:5 or A=0,0.5 (may be given more than once for a grid)\\n"
+    "--sweep-random: Render this many random points inside the --sweep ranges instead of the grid\\n"
+    "--sweep-seed: Seed for --sweep-random (default 1)\\n"
+    "--sweep-results: Write the sweep's CSV results to this file (default stdout)\\n"
+    "--sweep-wav: Also save each sweep point as a WAV file named with this prefix\\n"
+    "--threads: Threads to render a sweep on (default one per core)\\n"
     "-help, --help: Print this message\\n";
 
 void bailError(const std::string &name, const std::string &err) {{
@@ -427,69 +606,486 @@ void bailError(const std::string &name, const std::string &err) {{
     exit(1);
 }}
 
-#include "{infile}"
+void listPatches(FILE *out) {{
+    const std::vector<SimPatchEntry> &entries = SimPatchRegistry::entries();
+    for(size_t c = 0; c < entries.size(); c++)
+        fprintf(out, "  %-24s %-28s %8zu bytes\\n", entries[c].name, entries[c].file, entries[c].size);
+}}
+
+// Fetch the parameter following argument c, or bail if there isn't one
+const char *argParameter(int argc, char **argv, int &c, const std::string &arg) {{
+    if (c+1 >= argc)
+        bailError(argv[0], arg + " missing parameter");
+    c++;
+    return argv[c];
+}}
+
+float _simSampleRate = {sampleRate};
+SIM_THREAD_LOCAL int _simBlockSize = {blockSize};
+SIM_THREAD_LOCAL bool _simProfiling = true;
+
+MidiOutLog midiOut;
+void _simSendMidi(MidiMessage msg) {{
+    SimHeapScope untracked(false); // The log's growth isn't the patch's
+    if (simMidiOutLog)
+        simMidiOutLog->record(msg);
+}}
+
+// Sections registered by support/profile.h. Registration happens during static
+// initialization, which is fine because NULL pointers need no constructor.
+SimProfileSection *profileSections = NULL, **profileSectionsEnd = &profileSections;
+void _simProfileRegister(SimProfileSection *section) {{
+    section->next = NULL;
+    *profileSectionsEnd = section;
+    profileSectionsEnd = &section->next;
+}}
+
+void reportProfile(FILE *out, uint64_t ticks, uint64_t ns, double processAudioNs) {{
+    double nsPerTick = ticks ? (double)ns/ticks : 1;
+    bool header = false;
+    for(SimProfileSection *s = profileSections; s; s = s->next) {{
+        if (!s->calls)
+            continue; // Another patch's, or never reached
+        if (!header)
+            fprintf(out, "  profile sections (ns):\\n");
+        header = true;
+        double total = s->ticks*nsPerTick;
+        fprintf(out, "    %-20s %10u calls  mean %10.1f  max %10.0f  total %12.0f", s->name, s->calls,
+            total/s->calls, s->maxTicks*nsPerTick, total);
+        if (processAudioNs > 0)
+            fprintf(out, "  (%.1f%% of processAudio)", 100*total/processAudioNs);
+        fprintf(out, "\\n");
+    }}
+}}
+
+const char *_simResourceDir = ".";
+std::mutex resourceLock; // Sweeps load from many threads
+BlockTimes resourceTimes;
+uint64_t resourceBytes = 0;
+void _simResourceLoaded(const char *name, size_t size, uint64_t ns, bool found) {{
+    std::lock_guard<std::mutex> guard(resourceLock);
+    resourceTimes.add(ns, 0);
+    resourceBytes += size;
+    if (!found)
+        fprintf(stderr, "Note: resource %s not found in %s\\n", name, _simResourceDir);
+}}
+
+// Memory on the Magus's STM32F427, for the --bench memory report
+#define MAGUS_SRAM_BYTES (192LL << 10)
+#define MAGUS_SDRAM_BYTES (8LL << 20)
 
 #define NOTECOUNT {noteLen}
 
 int noteAt[NOTECOUNT] = {{{noteAt}}};
 MidiMessage notes[NOTECOUNT] = {{{noteContent}}};
-int processingNote = 0;
 
 int main(int argc, char **argv) {{
-    int samples = {sampleRate};
+    uint64_t profileStartTicks = _simProfileNow(); // For converting profile ticks to ns
+    BenchClock::time_point profileStart = BenchClock::now();
+    int samples = -1;
     bool human = false;
-    const int frameSize = 1024;
+    bool bench = false;
+    bool realtime = false;
+    bool digestOnly = false;
+    bool midiAllStages = false;
+    bool countersWanted = false;
+    const char *midiInPath = NULL;
+    MidiStress stress;
+    bool midiInUsb = false;
+    int worstBlocks = 5;
+    int frameSize = {blockSize};
+    std::vector<const char *> midiFiles;
+    const char *wavPath = NULL;
+    const char *inputPath = NULL;
+    const char *automationPath = NULL;
+    float screenRate = 20;
+    const char *screenDump = NULL;
+    const char *midiOutPath = NULL;
+    AudioFormat wavFormat = AUDIO_WAV_FLOAT;
+    const char *patchName = NULL;
+    Sweep sweep;
+    bool sweepRandom = false;
+    size_t sweepPoints = 0;
+    unsigned sweepSeed = 1;
+    const char *sweepResults = NULL;
+    Sweep::Render sweepRender;
 
     for (int c = 1; c < argc; c++) {{
         std::string arg = argv[c];
         if (arg == "--help" || arg == "-help") {{
             printf("%s\\n\\n", explanation);
             printf(usage, argv[0]);
+            printf("\\nPatches:\\n");
+            listPatches(stdout);
             exit(0); // BAIL OUT
+        }} else if (arg == "--list") {{
+            listPatches(stdout);
+            exit(0);
+        }} else if (arg == "-p" || arg == "--patch") {{
+            patchName = argParameter(argc, argv, c, arg);
+        }} else if (arg == "--midi-all-stages") {{
+            midiAllStages = true;
         }} else if (arg == "-s" || arg == "--samples") {{
-            if (c+1 >= argc)
-                bailError(argv[0], arg + " missing parameter");
-            samples = atoi(argv[c+1]);
-            c++;
+            samples = atoi(argParameter(argc, argv, c, arg));
+        }} else if (arg == "-r" || arg == "--sample-rate") {{
+            _simSampleRate = atof(argParameter(argc, argv, c, arg));
+            if (_simSampleRate <= 0)
+                bailError(argv[0], arg + " must be positive");
+        }} else if (arg == "-b" || arg == "--block-size") {{
+            frameSize = atoi(argParameter(argc, argv, c, arg));
+            if (frameSize <= 0)
+                bailError(argv[0], arg + " must be positive");
         }} else if (arg == "-h" || arg == "--human") {{
             human = true;
+        }} else if (arg == "--screen-rate") {{
+            screenRate = atof(argParameter(argc, argv, c, arg));
+        }} else if (arg == "--screen-dump") {{
+            screenDump = argParameter(argc, argv, c, arg);
+        }} else if (arg == "--resources") {{
+            _simResourceDir = argParameter(argc, argv, c, arg);
+        }} else if (arg == "--midi-out") {{
+            midiOutPath = argParameter(argc, argv, c, arg);
+        }} else if (arg == "--bench") {{
+            bench = true;
+        }} else if (arg == "--digest") {{
+            digestOnly = true;
+        }} else if (arg == "--counters") {{
+            countersWanted = true;
+        }} else if (arg == "--realtime") {{
+            realtime = true;
+        }} else if (arg == "--worst") {{
+            worstBlocks = atoi(argParameter(argc, argv, c, arg));
+        }} else if (arg == "--sweep") {{
+            if (!sweep.addAxis(argParameter(argc, argv, c, arg)))
+                bailError(argv[0], arg + ": " + sweep.getError());
+        }} else if (arg == "--sweep-random") {{
+            sweepRandom = true;
+            sweepPoints = atoi(argParameter(argc, argv, c, arg));
+        }} else if (arg == "--sweep-seed") {{
+            sweepSeed = strtoul(argParameter(argc, argv, c, arg), NULL, 10);
+        }} else if (arg == "--sweep-results") {{
+            sweepResults = argParameter(argc, argv, c, arg);
+        }} else if (arg == "--sweep-wav") {{
+            sweepRender.wavPrefix = argParameter(argc, argv, c, arg);
+        }} else if (arg == "--threads") {{
+            sweepRender.threads = atoi(argParameter(argc, argv, c, arg));
+        }} else if (arg == "-m" || arg == "--midi") {{
+            midiFiles.push_back(argParameter(argc, argv, c, arg));
+        }} else if (arg == "--midi-in") {{
+            midiInPath = argParameter(argc, argv, c, arg);
+        }} else if (arg == "--midi-in-usb") {{
+            midiInUsb = true;
+        }} else if (arg == "--stress") {{
+            if (!stress.add(argParameter(argc, argv, c, arg)))
+                bailError(argv[0], arg + ": " + stress.getError());
+        }} else if (arg == "--stress-seed") {{
+            stress.setSeed(strtoul(argParameter(argc, argv, c, arg), NULL, 10));
+        }} else if (arg == "-a" || arg == "--automation") {{
+            automationPath = argParameter(argc, argv, c, arg);
+        }} else if (arg == "-i" || arg == "--input") {{
+            inputPath = argParameter(argc, argv, c, arg);
+        }} else if (arg == "-w" || arg == "--wav") {{
+            wavPath = argParameter(argc, argv, c, arg);
+        }} else if (arg == "--wav-format") {{
+            std::string fmt = argParameter(argc, argv, c, arg);
+            if (fmt == "float" || fmt == "32")
+                wavFormat = AUDIO_WAV_FLOAT;
+            else if (fmt == "16")
+                wavFormat = AUDIO_WAV_16;
+            else if (fmt == "24")
+                wavFormat = AUDIO_WAV_24;
+            else
+                bailError(argv[0], "Unknown " + arg + " " + fmt);
+        }}
+    }}
+    if (samples < 0)
+        samples = _simSampleRate;
+    if (digestOnly && (wavPath || human))
+        bailError(argv[0], "--digest replaces the output, so it can't be used with --wav or --human");
+    // Gather compiled-in notes and MIDI files into one queue in dispatch order
+    std::vector<SimEvent> events;
+    for(int c = 0; c < NOTECOUNT; c++)
+        events.push_back(SimEvent(noteAt[c], notes[c]));
+    for(size_t c = 0; c < midiFiles.size(); c++) {{
+        MidiFileReader reader;
+        if (!reader.read(midiFiles[c], _simSampleRate, events))
+            bailError(argv[0], std::string(midiFiles[c]) + ": " + reader.getError());
+    }}
+    stress.generate(samples, _simSampleRate, events);
+    sortSimEvents(events);
+
+    SimChain chain;
+    if (patchName) {{
+        if (!chain.parse(patchName, events, midiAllStages)) {{
+            fprintf(stderr, "Error: %s. Built in:\\n", chain.getError().c_str());
+            listPatches(stderr);
+            exit(1);
         }}
+    }} else if (SimPatchRegistry::entries().size() == 1) {{
+        chain.parse(SimPatchRegistry::entries()[0].name, events, midiAllStages);
+    }} else {{
+        bailError(argv[0], "Several patches are built in, choose one with --patch");
     }}
+    const SimPatchEntry *patch = chain.entry(0);
+    _simBlockSize = frameSize; // Patch constructors may ask for this
 
-    {_class} generator;
+    Automation automation;
+    if (automationPath && !automation.load(automationPath, _simSampleRate))
+        bailError(argv[0], std::string(automationPath) + ": " + automation.getError());
+    if (automationPath)
+        chain.setAutomation(automation);
+
+    if (!sweep.empty()) {{
+        if (chain.size() > 1)
+            bailError(argv[0], "--sweep renders one patch, not several in series");
+        if (realtime)
+            bailError(argv[0], "--realtime can't be used with --sweep");
+        if (midiInPath)
+            bailError(argv[0], "--midi-in can't be used with --sweep");
+        if (countersWanted)
+            bailError(argv[0], "--counters can't be used with --sweep");
+        // Every point needs the whole input, so it is decoded up front rather than streamed
+        std::vector<float> sweepInput;
+        if (inputPath) {{
+            WavReader reader;
+            if (!reader.open(inputPath))
+                bailError(argv[0], std::string(inputPath) + ": " + reader.getError());
+            sweepInput.resize(2*samples);
+            sweepInput.resize(2*reader.read(&sweepInput[0], samples));
+        }}
+        if (sweepRandom)
+            sweep.setRandom(sweepPoints, sweepSeed);
+        FILE *results = sweepResults ? fopen(sweepResults, "w") : stdout;
+        if (!results)
+            bailError(argv[0], std::string("Couldn't write ") + sweepResults);
+        sweepRender.patch = patch;
+        sweepRender.samples = samples;
+        sweepRender.blockSize = frameSize;
+        sweepRender.events = &events;
+        sweepRender.automation = automationPath ? &automation : NULL;
+        sweepRender.input = inputPath ? &sweepInput : NULL;
+        sweepRender.wavFormat = wavFormat;
+        bool ok = sweep.run(sweepRender, results);
+        if (sweepResults)
+            fclose(results);
+        return ok ? 0 : 1;
+    }}
+
+    simMidiOutLog = &midiOut;
+    simHeapPhase();
+    BenchClock::time_point constructStart = BenchClock::now();
+    bool created;
+    {{
+        SimHeapScope heap;
+        created = chain.create();
+    }}
+    uint64_t constructNs = benchNs(constructStart, BenchClock::now());
+    if (!created)
+        bailError(argv[0], chain.getError());
+    SimHeapCounts constructHeap = simHeapPhase();
+    midiOut.endStartup();
     AudioBuffer buffer(frameSize);
-    std::vector<float> mix;
+    AudioInput input;
+    if (inputPath) {{
+        if (!input.open(inputPath))
+            bailError(argv[0], std::string(inputPath) + ": " + input.getError());
+        if (input.getSampleRate() != _simSampleRate)
+            fprintf(stderr, "Warning: %s is %g Hz but the simulation runs at %g Hz; it will not be resampled\\n",
+                inputPath, input.getSampleRate(), _simSampleRate);
+    }}
+    AudioWriter writer;
+    MonochromeScreenPatch *screenPatch = chain.screenPatch();
+    MonochromeScreenBuffer screen;
+    SimCallbackTimes callbackTimes;
+    if (bench)
+        simCallbackTimes = &callbackTimes;
+    double screenPeriod = screenRate > 0 ? _simSampleRate/screenRate : 0;
+    double nextScreen = 0;
+    int screenFrame = 0;
+    AudioDigest digest;
+    if (!bench && !digestOnly && (wavPath || !human)) {{
+        if (!writer.open(wavPath, wavPath ? wavFormat : AUDIO_RAW_FLOAT, _simSampleRate))
+            bailError(argv[0], std::string("Couldn't open ") + wavPath);
+    }} else if (human) {{
+        setvbuf(stdout, NULL, _IOFBF, 1 << 20);
+    }}
+    BlockTimes times;
+    if (bench)
+        times.reserve(samples/frameSize + 1);
+    SimMidiCheck midiCheck;
+    if (!stress.empty()) {{
+        simMidiCheck = &midiCheck;
+        midiCheck.startWatchdog(1000);
+    }}
+    LiveMidiInput liveMidi;
+    std::vector<LiveMidiEvent> liveEvents;
+    LatencyHistogram liveToProcess, liveToBlockEnd; // From arrival
+    if (midiInPath && !liveMidi.open(midiInPath, midiInUsb))
+        bailError(argv[0], "--midi-in " + liveMidi.getError());
+    PerfCounters counters;
+    if (countersWanted) {{
+        if (counters.open())
+            simPerfCounters = &counters;
+        else
+            fprintf(stderr, "Note: no performance counters available, see the report at the end\\n");
+    }}
+    RealtimePacer pacer;
+    RealtimeOutput realtimeOut(writer);
+    bool realtimeWriter = realtime && !bench && !digestOnly && (wavPath || !human);
+    if (realtimeWriter)
+        realtimeOut.start();
+    if (realtime)
+        pacer.begin(_simSampleRate);
 
     for(int off = 0; off < samples; off += frameSize) {{
         int currentFrameSize = std::min(frameSize, samples-off);
-        buffer._left._size  = currentFrameSize;
-        buffer._right._size = currentFrameSize;
-        buffer._clear();
+        if (realtime)
+            pacer.wait(off);
+        buffer._window(0, currentFrameSize);
+        if (inputPath)
+            input.fill(buffer._left._data, buffer._right._data, currentFrameSize);
+        else
+            buffer._clear();
 
-        if (processingNote < NOTECOUNT && noteAt[processingNote] <= off) {{
-          generator.processMidi(notes[processingNote]);
-          processingNote++;
+        BenchClock::time_point frameStart = BenchClock::now();
+        if (midiInPath) {{
+            liveEvents.clear();
+            liveMidi.poll(liveEvents);
+            midiOut.now = off;
+            for(size_t e = 0; e < liveEvents.size(); e++) {{
+                liveToProcess.record(benchNs(liveEvents[e].arrived, BenchClock::now()));
+                chain.processMidi(liveEvents[e].msg);
+            }}
         }}
+        chain.processBlock(buffer, off, currentFrameSize, frameSize, bench && chain.size() > 1);
+        BenchClock::time_point frameEnd = BenchClock::now();
+        uint64_t frameNs = benchNs(frameStart, frameEnd);
+        for(size_t e = 0; e < liveEvents.size(); e++)
+            liveToBlockEnd.record(benchNs(liveEvents[e].arrived, frameEnd));
+        if (realtime)
+            pacer.done(off, currentFrameSize);
 
-        generator.processAudio(buffer);
+        // On the device the screen is drawn between audio blocks, so it happens here too
+        if (screenPatch && screenPeriod > 0 && off >= nextScreen) {{
+            midiOut.now = off;
+            BenchClock::time_point screenStart = BenchClock::now();
+            {{
+                SimHeapScope heap;
+                screenPatch->processScreen(screen);
+            }}
+            callbackTimes.processScreen.record(benchNs(screenStart, BenchClock::now()));
+            if (screenDump) {{
+                char name[32];
+                snprintf(name, sizeof(name), "%05d.pbm", screenFrame);
+                if (!screen.writePbm((std::string(screenDump) + name).c_str()))
+                    bailError(argv[0], std::string("Couldn't write ") + screenDump + name);
+            }}
+            screenFrame++;
+            while (nextScreen <= off)
+                nextScreen += screenPeriod;
+        }}
 
-        if (human) {{
+        if (bench)
+            times.add(frameNs, currentFrameSize);
+        if (digestOnly) {{
+            digest.add(buffer._left._data, buffer._right._data, currentFrameSize);
+        }} else if (bench) {{
+            // Output discarded
+        }} else if (human && !wavPath) {{
             for(int idx = 0; idx < currentFrameSize; idx++)
                 printf("%8.8f %8.8f\\n", buffer._left._data[idx], buffer._right._data[idx]);
+        }} else if (realtimeWriter) {{
+            realtimeOut.write(buffer._left._data, buffer._right._data, currentFrameSize);
         }} else {{
-            mix.reserve(currentFrameSize*2);
-            mix.clear();
-            for(int idx = 0; idx < currentFrameSize; idx++) {{
-                mix.push_back(buffer._left._data[idx]);
-                mix.push_back(buffer._right._data[idx]);
-            }}
-            fwrite(&mix[0], sizeof(float), currentFrameSize*2, stdout);
+            writer.write(buffer._left._data, buffer._right._data, currentFrameSize);
         }}
     }}
+    simPerfCounters = NULL;
+    realtimeOut.close();
+    writer.close();
+    liveMidi.close();
+    midiCheck.stopWatchdog();
+    SimHeapCounts processHeap = simHeapPhase();
+    {{
+        SimHeapScope heap;
+        chain.destroy(); // Patches may do work in their destructors, as they would when unloaded
+    }}
+    SimHeapCounts destroyHeap = simHeapPhase();
+
+    if (digestOnly) {{
+        char summary[80];
+        digest.format(summary, sizeof(summary));
+        printf("%s %llu %llu\\n", summary, (unsigned long long)digest.getFrames(), (unsigned long long)digest.getNonFinite());
+    }}
+    if (bench) {{
+        times.report(stdout, chain.getName(), _simSampleRate, frameSize);
+        if (worstBlocks > 0)
+            times.reportWorst(stdout, worstBlocks, _simSampleRate, frameSize);
+        if (chain.size() > 1)
+            chain.report(stdout, _simSampleRate, frameSize);
+        // processAudio is held to the whole block's deadline even when MIDI splits the block
+        callbackTimes.processAudio.report(stdout, "processAudio", frameSize * 1e9 / _simSampleRate);
+        if (callbackTimes.processMidi.count())
+            callbackTimes.processMidi.report(stdout, "processMidi");
+        if (callbackTimes.buttonChanged.count())
+            callbackTimes.buttonChanged.report(stdout, "buttonChanged");
+        if (callbackTimes.processScreen.count())
+            callbackTimes.processScreen.report(stdout, "processScreen", screenPeriod * 1e9 / _simSampleRate);
+        reportProfile(stdout, _simProfileNow() - profileStartTicks, benchNs(profileStart, BenchClock::now()),
+            callbackTimes.processAudio.mean() * callbackTimes.processAudio.count());
+        printf("  constructor %llu ns\\n", (unsigned long long)constructNs);
+        for(size_t c = 0; c < chain.size(); c++)
+            printf("  memory: sizeof(%s) %zu bytes, alignof %zu\\n", chain.entry(c)->name, chain.entry(c)->size, chain.entry(c)->align);
+        if (simHeapAvailable()) {{
+            simHeapReport(stdout, "construction", constructHeap);
+            simHeapReport(stdout, "processing", processHeap);
+            simHeapReport(stdout, "destruction", destroyHeap);
+            long long highWater = chain.patchBytes() + std::max(constructHeap.peakLive, processHeap.peakLive);
+            printf("  memory high-water mark: %lld bytes (patch %s plus live heap), %s\\n", highWater,
+                chain.size() > 1 ? "objects" : "object",
+                highWater <= MAGUS_SRAM_BYTES ? "fits in the Magus's 192 KB internal SRAM" :
+                highWater <= MAGUS_SDRAM_BYTES ? "needs the Magus's 8 MB external SDRAM" : "more than the Magus has");
+        }} else {{
+            printf("  heap: not tracked on this platform\\n");
+        }}
+        if (!resourceTimes.ns.empty()) {{
+            resourceTimes.reportCalls(stdout, "Resource::load");
+            printf("  Resource::load: %llu bytes mapped\\n", (unsigned long long)resourceBytes);
+        }}
+        if (midiOut.size() > 0)
+            midiOut.report(stdout, _simSampleRate, frameSize, samples);
+    }}
+    if (!stress.empty())
+        midiCheck.report(stderr);
+    if (countersWanted)
+        counters.report(stderr);
+    if (midiInPath) {{
+        fprintf(stderr, "Live MIDI: %llu messages", (unsigned long long)liveToProcess.count());
+        if (liveMidi.getSkipped())
+            fprintf(stderr, ", %llu non-channel bytes or packets skipped", (unsigned long long)liveMidi.getSkipped());
+        if (liveMidi.getDropped())
+            fprintf(stderr, ", %llu dropped because the queue was full", (unsigned long long)liveMidi.getDropped());
+        fprintf(stderr, "\\n");
+        if (liveToProcess.count()) {{
+            liveToProcess.report(stderr, "arrival to processMidi", 0, true);
+            liveToBlockEnd.report(stderr, "arrival to end of block", 0, true);
+        }}
+    }}
+    if (realtime) {{
+        pacer.report(stderr);
+        if (realtimeWriter)
+            realtimeOut.report(stderr);
+    }}
+    if (midiOutPath) {{
+        if (!midiOut.write(midiOutPath, _simSampleRate))
+            bailError(argv[0], std::string("Couldn't write ") + midiOutPath);
+        if (!bench)
+            midiOut.report(stderr, _simSampleRate, frameSize, samples);
+    }}
 
     return 0;
 }}
-""".format(infile=infile, _class=_class, sampleRate=sampleRate, noteLen=len(notes),
+""".format(sampleRate=sampleRate, blockSize=blockSize, noteLen=len(notes),
   noteAt=", ".join([str(n[0]) for n in notes]),
   noteContent=", ".join(
       [
@@ -504,8 +1100,122 @@ int main(int argc, char **argv) {{
     )
   ))
 
-    # Compile
-    result = subprocess.call([cxx, "__driver.cpp", "-I.", "-o", output])
+    # Everything the build directory will hold, as (relative path, contents). Includes come
+    # first, so like the copies in stage() a same-named fake or generated file wins.
+    fakesDir = os.path.join(simDir, "fakes")
+    def includeName(pair):
+        d, filename = pair
+        return (d and d.replace(os.sep, "/") + "/" or "") + os.path.basename(filename)
+    staged = ([(includeName(pair), fileBytes(pair[1])) for pair in include]
+        + [("driver/" + rel, data) for rel, data in treeParts(os.path.join(simDir, "driver"))]
+        + [(name, fileBytes(os.path.join(fakesDir, name))) for name in sorted(os.listdir(fakesDir))]
+        + sorted(generated.items()))
+    runtimeSources = sorted("driver/" + name for name in os.listdir(os.path.join(simDir, "driver")) if name.endswith(".cpp"))
+
+    # Copy files into a temp dir, which is removed again when the build finishes
+    # TODO: Some method for copying files to subdirs
+    def stage():
+        buildDir = tempfile.mkdtemp()
+        print("Building in directory "+buildDir)
+        os.chdir(buildDir)
+        for pair in include:
+          d, filename = prepUnpackPair(pair, buildDir)
+          shutil.copy(filename, d)
+        shutil.copytree(os.path.join(simDir, "driver"), os.path.join(buildDir, "driver"))
+        for name in os.listdir(fakesDir):
+          shutil.copy(os.path.join(fakesDir, name), buildDir)
+        for name, text in generated.items():
+          with open(name, "w") as f:
+            f.write(text)
+        return buildDir
+    startDir = os.getcwd()
+    def unstage(buildDir):
+        os.chdir(startDir)
+        shutil.rmtree(buildDir, ignore_errors=True)
+
+    # Cross-compile one patch with the bare-metal driver. Not cached; the ELF is only an input to CortexMagusSim.py.
+    if target != "host":
+        if cxx == "c++":
+            cxx = "arm-none-eabi-g++"
+        fpu = target == "cortex-m7" and "fpv5-sp-d16" or "fpv4-sp-d16" # Single precision only, as on the Magus
+        _class, infile = patches[0]
+        command = [cxx, "-mcpu=" + target, "-mthumb", "-mfpu=" + fpu, "-mfloat-abi=hard"] + shlex.split(cxxflags) + [
+            "-I.", "-DSIM_BARE_METAL", "-DSIM_PATCH_CLASS=" + _class, "-DSIM_PATCH_HEADER=\"" + infile + "\"",
+            "cortexm/main.cpp", "--specs=rdimon.specs", "-lm", "-o", output]
+        buildDir = stage()
+        try:
+            shutil.copytree(os.path.join(simDir, "cortexm"), os.path.join(buildDir, "cortexm"))
+            sys.exit(subprocess.call(command))
+        except OSError:
+            raise click.ClickException("Couldn't run cross compiler "+cxx+", set --cxx")
+        finally:
+            unstage(buildDir)
+
+    # Compile. The driver/*.cpp runtime only depends on the simulator itself and the compiler,
+    # so it is built once per toolchain; the patches are then compiled alone and linked against it.
+    # Both are cached by a hash of everything that went into them, worked out before anything is
+    # staged, so a cache hit copies out the binary and touches nothing else.
+    flags = shlex.split(cxxflags)
+    def compiler(args):
+        return subprocess.call([cxx] + flags + args + ["-I.", "-pthread"])
+    def compilePatches(): # One compiler per patch, as many at once as there are CPUs
+        pool = ThreadPool(multiprocessing.cpu_count())
+        results = pool.map(lambda source: compiler(["-c", source, "-o", source[:-4] + ".o"]), patchSources)
+        pool.close()
+        if any(results):
+            sys.exit(1)
+        return [source[:-4] + ".o" for source in patchSources]
+
+    if no_cache:
+        buildDir = stage()
+        try:
+            objects = []
+            for source in runtimeSources:
+                obj = source[:-4] + ".o"
+                if compiler(["-c", source, "-o", obj]):
+                    sys.exit(1)
+                objects.append(obj)
+            sys.exit(compiler(["__driver.cpp"] + compilePatches() + objects + ["-o", output]))
+        finally:
+            unstage(buildDir)
+
+    try:
+        version = subprocess.check_output([cxx, "--version"], stderr=subprocess.STDOUT)
+    except (OSError, subprocess.CalledProcessError):
+        raise click.ClickException("Couldn't run C++ compiler "+cxx)
+    toolchain = [("generator", fileBytes(os.path.abspath(__file__).replace(".pyc", ".py"))),
+        ("cxx", cxx), ("flags", "\0".join(flags)), ("version", version)]
+    runtimeKey = hashParts(toolchain + treeParts(os.path.join(simDir, "driver")) + treeParts(fakesDir)
+        + [("__SIM_INCLUDE.h", generated["__SIM_INCLUDE.h"])])
+    binaryKey = hashParts([("runtime", runtimeKey)] + staged)
+    cacheDir = os.path.abspath(cache_dir or defaultCacheDir())
+
+    binDir = os.path.join(cacheDir, "bin-" + binaryKey)
+    cachedBinary = os.path.join(binDir, "sim")
+    if os.path.exists(cachedBinary):
+        print("Reusing cached build "+binDir)
+        shutil.copy2(cachedBinary, output)
+        sys.exit(0)
+
+    buildDir = stage()
+    try:
+        runtimeDir = os.path.join(cacheDir, "runtime-" + runtimeKey)
+        makedirs(runtimeDir)
+        objects = []
+        for source in runtimeSources:
+            obj = os.path.join(runtimeDir, os.path.basename(source)[:-4] + ".o")
+            if not os.path.exists(obj):
+                if compiler(["-c", source, "-o", source[:-4] + ".o"]):
+                    sys.exit(1)
+                cacheStore(source[:-4] + ".o", obj)
+            objects.append(obj)
+
+        result = compiler(["__driver.cpp"] + compilePatches() + objects + ["-o", output])
+        if result == 0:
+            makedirs(binDir)
+            cacheStore(output, cachedBinary)
+    finally:
+        unstage(buildDir)
 
     sys.exit(result)
 
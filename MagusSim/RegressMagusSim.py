@@ -0,0 +1,258 @@
+#!/usr/bin/env python
+# Regression suite for the patches in this repository. Builds every patch into one simulator,
+# renders each under fixed MIDI, knob and audio input scenarios, and compares the audio and
+# sendMidi output against reference renders, and ns/sample against reference timings.
+# The audio and MIDI references are deterministic and checked in; the timings in perf.json
+# are specific to one machine, so each machine makes its own with --bless and they are not.
+# License https://creativecommons.org/publicdomain/zero/1.0/
+
+import sys
+import os
+import os.path
+import glob
+import json
+import shutil
+import struct
+import tempfile
+import subprocess
+from array import array
+try:
+    import click
+except ImportError:
+    sys.stderr.write("Error: \"Click\" module missing. Run `pip install click`\n")
+    sys.exit(1)
+
+simDir = os.path.dirname(os.path.abspath(__file__))
+repoDir = os.path.dirname(simDir)
+
+# Support files every patch build gets, as MakeMagusSim.py --include arguments
+includes = ["support:support/patchForSlot.h", "support:support/midi.h", "support:support/noteNames.h",
+    "support:support/midiPatchBase.hpp", "support:support/display.h", "support:support/profile.h",
+    "MagusSim/fakes/basicmaths.h"]
+
+SAMPLE_RATE = 44100
+
+# MIDI helpers for scenarios. Times are in seconds.
+def noteOn(t, note, velocity=100, channel=0):
+    return (t, [0x90 | channel, note, velocity])
+def noteOff(t, note, channel=0):
+    return (t, [0x80 | channel, note, 0])
+def cc(t, number, value, channel=0):
+    return (t, [0xB0 | channel, number, value])
+def bend(t, value, channel=0): # value -8192..8191
+    value += 8192
+    return (t, [0xE0 | channel, value & 0x7F, (value >> 7) & 0x7F])
+
+def melody(channel=0):
+    events = []
+    for c, note in enumerate([60, 64, 67, 72, 67, 64, 48]):
+        events += [noteOn(0.1 + c*0.12, note, 100, channel), noteOff(0.2 + c*0.12, note, channel)]
+    events += [noteOn(0.95, 60, 80, channel), noteOn(0.96, 63, 80, channel), noteOn(0.97, 67, 80, channel)] # Held chord
+    return events
+
+# Each scenario renders one patch. Optional keys:
+#   midi        list of (seconds, [status, data...]) played with --midi
+#   automation  list of (seconds, parameter, value) played with --automation
+#   input       name of another scenario whose audio is fed in with --input
+#   seconds     length of the render (default 1)
+scenarios = [
+    {"name": "silence", "patch": "Silence"},
+    {"name": "saw4", "patch": "Saw4"},
+    {"name": "saw4-knobs", "patch": "Saw4", "automation":
+        [(0, "A", 0), (1, "A", 1), (0, "B", 0.7), (1, "B", 0.1), (0, "16", 0.2), (1, "16", 0.8),
+         (0, "17", 0), (0.5, "17", 1), (1, "17", 0.3)]},
+    {"name": "puredelay", "patch": "PureDelay", "input": "saw4-knobs", "automation":
+        [(0, str(a), v) for a, v in [(0, 0.3), (2, 0.5), (12, 1.0), (9, 0.7), (13, 0.5), (14, 0.5)]]
+        + [(0.5, "0", 0.9), (1, "2", 0.1)]},
+    {"name": "puredelay-midi", "patch": "PureDelay", "input": "saw4", "midi": melody(),
+        "automation": [(0, "4", 1.0), (0, "12", 1.0), (0, "9", 1.0)]},
+    {"name": "midisquare", "patch": "MidiSquare", "midi": melody()},
+    {"name": "midisquaredrunk", "patch": "MidiSquareDrunk", "midi": melody()},
+    {"name": "midi2cv", "patch": "Midi2CV", "midi": melody() + [bend(0.3, 4096), bend(0.6, -8192), bend(0.9, 0)]},
+    {"name": "midi2cvtriplet", "patch": "Midi2CVTriplet", "midi": melody() + melody(1) + melody(2)},
+    {"name": "midimonitor", "patch": "MidiMonitor", "midi": melody() + [cc(0.5, 1, 64), cc(0.7, 7, 127)]},
+    {"name": "nanokontroltest", "patch": "NanoKontrolTest",
+        "midi": [cc(0.1 + c*0.05, n, 127) for c, n in enumerate([2, 3, 25, 33, 39, 47])]},
+    {"name": "nanokontrolseq", "patch": "NanoKontrolSeq", "seconds": 2, "midi":
+        [cc(0.05 + c*0.02, 2 + c, 20 + c*12) for c in range(8)]
+        + [cc(0.3, 25, 127), cc(0.35, 25, 0), cc(0.4, 39, 127), cc(0.45, 39, 0)]
+        + [cc(0.5, 33, 127), cc(0.55, 33, 0), cc(1.5, 34, 127), cc(1.55, 34, 0)]},
+    {"name": "screensaver", "patch": "ScreenSaver"},
+]
+
+# Minimal format 0 MIDI file, 10000 ticks per one-second quarter note (as the simulator writes)
+def writeMidi(path, events):
+    def vlq(v):
+        out = [v & 0x7F]
+        v >>= 7
+        while v:
+            out.insert(0, 0x80 | (v & 0x7F))
+            v >>= 7
+        return out
+    track = [0x00, 0xFF, 0x51, 0x03, 0x0F, 0x42, 0x40] # Tempo 1000000 us per quarter
+    last = 0
+    for t, msg in sorted(events, key=lambda e: e[0]):
+        tick = int(round(t * 10000))
+        track += vlq(tick - last) + msg
+        last = tick
+    track += [0x00, 0xFF, 0x2F, 0x00]
+    with open(path, "wb") as f:
+        f.write(b"MThd" + struct.pack(">IHHH", 6, 0, 1, 10000))
+        f.write(b"MTrk" + struct.pack(">I", len(track)) + bytearray(track))
+
+def writeAutomation(path, points):
+    with open(path, "w") as f:
+        for t, param, value in points:
+            f.write("%gs,%s,%g\n" % (t, param, value))
+
+def readFloats(path):
+    data = array("f")
+    with open(path, "rb") as f:
+        raw = f.read()
+    if hasattr(data, "frombytes"):
+        data.frombytes(raw)
+    else:
+        data.fromstring(raw)
+    return data
+
+def fileBytes(path):
+    with open(path, "rb") as f:
+        return f.read()
+
+# Largest absolute difference, or None if the lengths differ. NaN counts as infinitely different.
+def maxDifference(a, b):
+    if len(a) != len(b):
+        return None
+    worst = 0.0
+    for x, y in zip(a, b):
+        d = abs(x - y)
+        if not (d <= worst): # Also catches NaN
+            if d != d:
+                if x != x and y != y:
+                    continue
+                return float("inf")
+            worst = d
+    return worst
+
+@click.command(help="Renders every patch under fixed scenarios and compares the output and speed with reference renders. Timings are only checked once --bless has saved them on this machine.")
+@click.option('--bless', is_flag=True, help="Save this run's output and timings as the new references")
+@click.option('--reference', '-r', default=os.path.join(simDir, "reference"), type=click.STRING, help="Reference directory (default MagusSim/reference)")
+@click.option('--only', '-k', multiple=True, type=click.STRING, help="Only run scenarios with this name (may be given more than once)")
+@click.option('--tolerance', default=1e-5, type=click.FLOAT, help="Largest per-sample difference from the reference allowed (default 1e-5)")
+@click.option('--perf-tolerance', default=0.25, type=click.FLOAT, help="Fail if ns/sample is more than this fraction above the reference, plus --perf-floor (default 0.25)")
+@click.option('--perf-floor', default=0.5, type=click.FLOAT, help="ns/sample of slack on top of --perf-tolerance, so patches that take under a nanosecond per sample don't fail on timer noise (default 0.5)")
+@click.option('--no-perf', is_flag=True, help="Skip timing")
+@click.option('--repeat', default=3, type=click.INT, help="Time each scenario this many times and keep the fastest (default 3)")
+@click.option('--keep', is_flag=True, help="Don't delete the work directory")
+def regress(bless, reference, only, tolerance, perf_tolerance, perf_floor, no_perf, repeat, keep):
+    selected = [s for s in scenarios if not only or s["name"] in only]
+    if not selected:
+        raise click.ClickException("No scenarios match")
+    for s in selected: # Inputs have to be rendered even if not selected
+        if "input" in s and s["input"] not in [x["name"] for x in selected]:
+            raise click.ClickException("%s needs %s, add --only %s" % (s["name"], s["input"], s["input"]))
+
+    workDir = tempfile.mkdtemp()
+    binary = os.path.join(workDir, "magussim")
+    patchFiles = sorted(glob.glob(os.path.join(repoDir, "*Patch.hpp")))
+    command = [sys.executable, os.path.join(simDir, "MakeMagusSim.py")] + [os.path.basename(p) for p in patchFiles]
+    for i in includes:
+        command += ["-i", i]
+    command += ["-o", binary]
+    with open(os.path.join(workDir, "build.log"), "w") as log:
+        if subprocess.call(command, cwd=repoDir, stdout=log, stderr=subprocess.STDOUT):
+            raise click.ClickException("Build failed, see " + log.name)
+
+    perfPath = os.path.join(reference, "perf.json")
+    perf = {}
+    if os.path.exists(perfPath):
+        with open(perfPath) as f:
+            perf = json.load(f)
+    if bless and not os.path.isdir(reference):
+        os.makedirs(reference)
+
+    failures = []
+    print("%-18s %-10s %-12s %s" % ("scenario", "audio", "ns/sample", "reference ns/sample"))
+    for s in selected:
+        name = s["name"]
+        args = [binary, "--patch", s["patch"], "-s", str(int(s.get("seconds", 1) * SAMPLE_RATE)), "-r", str(SAMPLE_RATE)]
+        if "midi" in s:
+            path = os.path.join(workDir, name + ".mid")
+            writeMidi(path, s["midi"])
+            args += ["-m", path]
+        if "automation" in s:
+            path = os.path.join(workDir, name + ".csv")
+            writeAutomation(path, s["automation"])
+            args += ["-a", path]
+        if "input" in s:
+            args += ["-i", os.path.join(workDir, s["input"] + ".wav")]
+
+        # Audio, plus a WAV copy for scenarios that use it as input
+        rawPath = os.path.join(workDir, name + ".raw")
+        midiOutPath = os.path.join(workDir, name + ".out.mid")
+        with open(rawPath, "wb") as out, open(os.devnull, "w") as quiet:
+            if subprocess.call(args + ["--midi-out", midiOutPath], stdout=out, stderr=quiet, cwd=workDir):
+                failures.append(name + ": simulator failed")
+                print("%-18s %-10s" % (name, "CRASHED"))
+                continue
+            subprocess.call(args + ["-w", os.path.join(workDir, name + ".wav")], stderr=quiet, cwd=workDir)
+
+        status = "blessed"
+        refRaw = os.path.join(reference, name + ".raw")
+        refMidi = os.path.join(reference, name + ".out.mid")
+        if bless:
+            shutil.copy(rawPath, refRaw)
+            shutil.copy(midiOutPath, refMidi)
+        elif not os.path.exists(refRaw):
+            status = "no ref"
+            failures.append(name + ": no reference, run with --bless")
+        else:
+            diff = maxDifference(readFloats(rawPath), readFloats(refRaw))
+            if diff is None:
+                status = "LENGTH"
+                failures.append(name + ": output length differs from reference")
+            elif diff > tolerance:
+                status = "DRIFT"
+                failures.append("%s: output differs from reference by up to %g" % (name, diff))
+            elif not os.path.exists(refMidi) or fileBytes(refMidi) != fileBytes(midiOutPath):
+                status = "MIDI"
+                failures.append(name + ": sendMidi output differs from reference")
+            else:
+                status = diff and "ok (%.1e)" % diff or "ok"
+
+        nsText, refText = "", ""
+        if not no_perf:
+            best = None
+            for c in range(repeat):
+                report = subprocess.check_output(args + ["--bench"], cwd=workDir, stderr=open(os.devnull, "w"))
+                for line in report.decode("utf-8", "replace").splitlines():
+                    if line.strip().startswith("ns/sample"):
+                        ns = float(line.split()[1])
+                        best = ns if best is None else min(best, ns)
+            nsText = "%.2f" % best
+            if bless:
+                perf[name] = best
+            elif name in perf:
+                refText = "%.2f" % perf[name]
+                if best > perf[name] * (1 + perf_tolerance) + perf_floor:
+                    failures.append("%s: %.2f ns/sample, %.0f%% slower than reference %.2f" %
+                        (name, best, (best/perf[name] - 1)*100, perf[name]))
+                    refText += " SLOWER"
+        print("%-18s %-10s %-12s %s" % (name, status, nsText, refText))
+
+    if bless and not no_perf:
+        with open(perfPath, "w") as f:
+            json.dump(perf, f, indent=2, sort_keys=True)
+
+    if keep:
+        print("Work directory: " + workDir)
+    else:
+        shutil.rmtree(workDir)
+    if failures:
+        print("\n%d failed:" % len(failures))
+        for f in failures:
+            print("  " + f)
+        sys.exit(1)
+    print("\nAll %d scenarios passed" % len(selected))
+
+regress()
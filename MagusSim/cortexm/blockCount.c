@@ -0,0 +1,201 @@
+/* QEMU TCG plugin for CortexMagusSim.py. Counts the instructions the guest executes between
+ * calls to simBlockStart and simBlockEnd, with a rough Cortex-M cycle estimate, the number
+ * of divides and square roots, and how many instructions fell inside given functions.
+ * Arguments: start=ADDR,end=ADDR,out=PATH, and fn=NAME:ADDR:SIZE any number of times
+ * Writes one CSV line per start/end pair to the out file when the guest exits.
+ * License https://creativecommons.org/publicdomain/zero/1.0/ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <glib.h>
+#include <qemu-plugin.h>
+
+QEMU_PLUGIN_EXPORT int qemu_plugin_version = QEMU_PLUGIN_VERSION;
+
+#define MAX_FNS 256
+
+typedef struct {
+    char *name;
+    uint64_t low, high;
+} Function;
+
+typedef struct {
+    uint64_t insns, divides;
+    double cycles;
+    uint64_t inFunction[MAX_FNS];
+} Counts;
+
+/* What the exec callback needs to know about one translated instruction */
+typedef struct {
+    double cycles;
+    int divide;
+    int function; /* Index into functions, or -1 */
+    int mark;     /* 1 at simBlockStart, 2 at simBlockEnd */
+} Insn;
+
+static Function functions[MAX_FNS];
+static int functionCount;
+static uint64_t startAddr, endAddr;
+static const char *outPath = "blockcount.csv";
+
+static Counts current;
+static int counting;
+static GArray *records;
+
+/* Registers named in a {list}, for the multiple load/store instructions */
+static int registerCount(const char *dis) {
+    const char *open = strchr(dis, '{');
+    int count = 1;
+    if (!open)
+        return 1;
+    for (const char *c = open; *c && *c != '}'; c++) {
+        if (*c == ',')
+            count++;
+        else if (*c == '-') /* A range like r4-r7 counts as about 4 */
+            count += 2;
+    }
+    return count;
+}
+
+static int startsWith(const char *s, const char *prefix) {
+    return strncmp(s, prefix, strlen(prefix)) == 0;
+}
+
+/* The mnemonic alone, without its .w/.n width suffix: "bl" from "bl.w #0x8010" */
+static void mnemonicOf(const char *dis, char *out, size_t size) {
+    size_t n = 0;
+    while (dis[n] && dis[n] != ' ' && dis[n] != '\t' && dis[n] != '.' && n + 1 < size) {
+        out[n] = dis[n];
+        n++;
+    }
+    out[n] = 0;
+}
+
+static int isCondition(const char *s) {
+    static const char *conditions[] = {"eq", "ne", "cs", "hs", "cc", "lo", "mi", "pl", "vs", "vc",
+        "hi", "ls", "ge", "lt", "gt", "le", "al"};
+    for (size_t c = 0; c < sizeof(conditions)/sizeof(conditions[0]); c++)
+        if (!strcmp(s, conditions[c]))
+            return 1;
+    return 0;
+}
+
+/* Rough Cortex-M4 costs from the mnemonic: single issue, no cache misses, and small
+ * penalties for branches, calls and returns. A Cortex-M7 dual-issues and predicts branches,
+ * so for one this tends to be an overestimate. */
+static double cyclesFor(const char *dis, int *divide) {
+    char m[16];
+    mnemonicOf(dis, m, sizeof(m));
+    *divide = 0;
+    if (startsWith(dis, "vdiv") || startsWith(dis, "vsqrt")) {
+        *divide = 1;
+        return 14;
+    }
+    if (startsWith(dis, "sdiv") || startsWith(dis, "udiv")) {
+        *divide = 1;
+        return 7;
+    }
+    if (startsWith(dis, "ldm") || startsWith(dis, "stm") || startsWith(dis, "push") || startsWith(dis, "pop")
+        || startsWith(dis, "vldm") || startsWith(dis, "vstm") || startsWith(dis, "vpush") || startsWith(dis, "vpop"))
+        return 1 + registerCount(dis) / 2.0;
+    /* Compare whole mnemonics: "bl" is a call but "blt", "ble" and "bls" are branches */
+    if (!strcmp(m, "bl") || !strcmp(m, "blx") || (startsWith(m, "bx") && (!m[2] || isCondition(m + 2))))
+        return 3; /* Calls and returns */
+    if (!strcmp(m, "b") || (m[0] == 'b' && isCondition(m + 1)) || !strcmp(m, "cbz") || !strcmp(m, "cbnz"))
+        return 2; /* Branches, taken or not */
+    return 1;
+}
+
+static void exec(unsigned int cpu, void *udata) {
+    Insn *insn = udata;
+    if (insn->mark == 1) {
+        memset(&current, 0, sizeof(current));
+        counting = 1;
+    } else if (insn->mark == 2 && counting) {
+        g_array_append_val(records, current);
+        counting = 0;
+    }
+    if (!counting)
+        return;
+    current.insns++;
+    current.cycles += insn->cycles;
+    current.divides += insn->divide;
+    if (insn->function >= 0)
+        current.inFunction[insn->function]++;
+}
+
+static void translate(qemu_plugin_id_t id, struct qemu_plugin_tb *tb) {
+    size_t count = qemu_plugin_tb_n_insns(tb);
+    for (size_t c = 0; c < count; c++) {
+        struct qemu_plugin_insn *insn = qemu_plugin_tb_get_insn(tb, c);
+        uint64_t at = qemu_plugin_insn_vaddr(insn);
+        Insn *info = g_new0(Insn, 1); /* Lives as long as the translation, which is usually forever */
+        char *dis = qemu_plugin_insn_disas(insn);
+        info->cycles = cyclesFor(dis, &info->divide);
+        g_free(dis);
+        info->function = -1;
+        for (int f = 0; f < functionCount; f++) {
+            if (at >= functions[f].low && at < functions[f].high) {
+                info->function = f;
+                break;
+            }
+        }
+        info->mark = at == startAddr ? 1 : at == endAddr ? 2 : 0;
+        qemu_plugin_register_vcpu_insn_exec_cb(insn, exec, QEMU_PLUGIN_CB_NO_REGS, info);
+    }
+}
+
+static void finish(qemu_plugin_id_t id, void *p) {
+    FILE *out = fopen(outPath, "w");
+    if (!out) {
+        fprintf(stderr, "blockCount: couldn't write %s\n", outPath);
+        return;
+    }
+    fprintf(out, "record,insns,cycles,divides");
+    for (int f = 0; f < functionCount; f++)
+        fprintf(out, ",%s", functions[f].name);
+    fprintf(out, "\n");
+    for (guint r = 0; r < records->len; r++) {
+        Counts *c = &g_array_index(records, Counts, r);
+        fprintf(out, "%u,%" PRIu64 ",%.0f,%" PRIu64, r, c->insns, c->cycles, c->divides);
+        for (int f = 0; f < functionCount; f++)
+            fprintf(out, ",%" PRIu64, c->inFunction[f]);
+        fprintf(out, "\n");
+    }
+    fclose(out);
+}
+
+QEMU_PLUGIN_EXPORT int qemu_plugin_install(qemu_plugin_id_t id, const qemu_info_t *info, int argc, char **argv) {
+    for (int c = 0; c < argc; c++) {
+        char *arg = argv[c];
+        if (startsWith(arg, "start=")) {
+            startAddr = strtoull(arg + 6, NULL, 0) & ~1ull; /* Thumb addresses have bit 0 set */
+        } else if (startsWith(arg, "end=")) {
+            endAddr = strtoull(arg + 4, NULL, 0) & ~1ull;
+        } else if (startsWith(arg, "out=")) {
+            outPath = arg + 4;
+        } else if (startsWith(arg, "fn=") && functionCount < MAX_FNS) {
+            gchar **parts = g_strsplit(arg + 3, ":", 3);
+            if (parts[0] && parts[1] && parts[2]) {
+                Function *f = &functions[functionCount++];
+                f->name = g_strdup(parts[0]);
+                f->low = strtoull(parts[1], NULL, 0) & ~1ull;
+                f->high = f->low + strtoull(parts[2], NULL, 0);
+            }
+            g_strfreev(parts);
+        } else {
+            fprintf(stderr, "blockCount: don't understand %s\n", arg);
+            return -1;
+        }
+    }
+    if (!startAddr || !endAddr) {
+        fprintf(stderr, "blockCount: needs start= and end=\n");
+        return -1;
+    }
+    records = g_array_new(FALSE, TRUE, sizeof(Counts));
+    qemu_plugin_register_vcpu_tb_trans_cb(id, translate);
+    qemu_plugin_register_atexit_cb(id, finish, NULL);
+    return 0;
+}
@@ -0,0 +1,42 @@
+// Bare-metal driver for Cortex-M builds of one patch (MakeMagusSim.py --target), run under
+// qemu-arm by CortexMagusSim.py. Constructs the patch and runs processAudio on silent blocks,
+// calling simBlockStart/simBlockEnd around each so the blockCount plugin can split its
+// instruction counts per call. There are no threads, clocks, files or MIDI here, so
+// getResource() always returns NULL.
+// Arguments: blocks, block size, sample rate
+// License https://creativecommons.org/publicdomain/zero/1.0/
+
+#include "__SIM_INCLUDE.h"
+#include SIM_PATCH_HEADER
+
+float _simSampleRate = 44100;
+SIM_THREAD_LOCAL int _simBlockSize = 1024;
+SIM_THREAD_LOCAL bool _simProfiling = true;
+void _simSendMidi(MidiMessage msg) {}
+void _simProfileRegister(SimProfileSection *section) {}
+
+// The plugin watches for the first instruction of each of these
+extern "C" __attribute__((noinline)) void simBlockStart() { __asm__ volatile("" ::: "memory"); }
+extern "C" __attribute__((noinline)) void simBlockEnd() { __asm__ volatile("" ::: "memory"); }
+
+int main(int argc, char **argv) {
+  int blocks = argc > 1 ? atoi(argv[1]) : 50;
+  if (argc > 2)
+    _simBlockSize = atoi(argv[2]);
+  if (argc > 3)
+    _simSampleRate = atof(argv[3]);
+
+  simBlockStart(); // The constructor is counted as the first record
+  Patch *patch = new SIM_PATCH_CLASS();
+  simBlockEnd();
+
+  AudioBuffer buffer(_simBlockSize);
+  for(int c = 0; c < blocks; c++) {
+    buffer._clear();
+    simBlockStart();
+    patch->processAudio(buffer);
+    simBlockEnd();
+  }
+  printf("Ran %d blocks of %d\n", blocks, _simBlockSize);
+  return 0;
+}
@@ -0,0 +1,69 @@
+// WAV input streaming for MagusSim.
+// License https://creativecommons.org/publicdomain/zero/1.0/
+
+#include <chrono>
+#include "driver/audioInput.h"
+
+void AudioInput::run() {
+  std::vector<StereoFrame> chunk(CHUNK);
+  size_t have = 0, pushed = 0;
+  while (!stopping.load()) {
+    if (pushed == have) {
+      have = reader.read(&chunk[0].left, CHUNK);
+      pushed = 0;
+      if (have == 0)
+        break;
+    }
+    size_t got = ring.push(&chunk[pushed], have - pushed);
+    pushed += got;
+    if (got)
+      moved.notify_one();
+    if (pushed < have) // Ring full, the audio loop is behind
+      waitForRing();
+  }
+  finished.store(true);
+  moved.notify_one();
+}
+
+// Block until the other side moves frames through the ring. Notifies aren't made under
+// the lock, so one can slip past; the timeout bounds the wait, as RealtimeOutput's sleep does.
+void AudioInput::waitForRing() {
+  std::unique_lock<std::mutex> hold(lock);
+  moved.wait_for(hold, std::chrono::milliseconds(1));
+}
+
+bool AudioInput::open(const char *path) {
+  if (!reader.open(path))
+    return false;
+  thread = std::thread(&AudioInput::run, this);
+  return true;
+}
+
+void AudioInput::fill(float *left, float *right, size_t count) {
+  scratch.resize(count);
+  size_t got = 0;
+  while (got < count) {
+    bool done = finished.load(); // Check before popping so the last frames aren't missed
+    size_t popped = ring.pop(&scratch[got], count - got);
+    got += popped;
+    if (popped)
+      moved.notify_one();
+    if (got < count) {
+      if (done) break;
+      waitForRing();
+    }
+  }
+  for(size_t c = 0; c < got; c++) {
+    left[c] = scratch[c].left;
+    right[c] = scratch[c].right;
+  }
+  memset(left + got, 0, (count - got)*sizeof(float));
+  memset(right + got, 0, (count - got)*sizeof(float));
+}
+
+void AudioInput::close() {
+  stopping.store(true);
+  if (thread.joinable())
+    thread.join();
+  reader.close();
+}
@@ -0,0 +1,47 @@
+#ifndef __driver_audioInput_hpp__
+#define __driver_audioInput_hpp__
+
+// Streams a WAV file into the simulated AudioBuffer. A reader thread decodes ahead of
+// the audio loop into a bounded ring, so only the ring is ever held in memory.
+// License https://creativecommons.org/publicdomain/zero/1.0/
+
+#include <string.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "driver/ring.h"
+#include "driver/wavFile.h"
+
+class AudioInput {
+  WavReader reader;
+  SpscRing<StereoFrame> ring;
+  std::thread thread;
+  std::atomic<bool> finished; // Reader has pushed the last frame
+  std::atomic<bool> stopping; // Main thread wants the reader gone
+  std::vector<StereoFrame> scratch;
+  std::mutex lock;
+  std::condition_variable moved; // Signalled when either side pushes or pops, so the other needn't spin
+
+  static const size_t CHUNK = 4096;
+
+  void run();
+  void waitForRing();
+
+public:
+  AudioInput(size_t ringFrames = 1 << 16) : ring(ringFrames), finished(false), stopping(false) {}
+  ~AudioInput() { close(); }
+
+  const std::string &getError() { return reader.getError(); }
+  float getSampleRate() { return reader.getSampleRate(); }
+
+  bool open(const char *path);
+
+  // Fill one block. Waits for the reader if it has fallen behind; silence after end of file.
+  void fill(float *left, float *right, size_t count);
+
+  void close();
+};
+
+#endif // __driver_audioInput_hpp__
@@ -0,0 +1,97 @@
+// Parameter automation for MagusSim.
+// License https://creativecommons.org/publicdomain/zero/1.0/
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <algorithm>
+#include "driver/automation.h"
+
+int parameterIdFromName(const char *name) {
+  size_t len = strlen(name);
+  if (len > 0 && isdigit((unsigned char)name[0])) {
+    char *end;
+    long id = strtol(name, &end, 10);
+    return (*end || id < 0 || id > PARAMETER_DH) ? -1 : (int)id;
+  }
+  char a = toupper((unsigned char)name[0]);
+  if (len == 1 && a >= 'A' && a <= 'H')
+    return PARAMETER_A + (a - 'A');
+  if (len == 2) {
+    char b = toupper((unsigned char)name[1]);
+    if (a >= 'A' && a <= 'D' && b >= 'A' && b <= 'H')
+      return PARAMETER_AA + (a - 'A')*8 + (b - 'A');
+  }
+  return -1;
+}
+
+int buttonIdFromName(const char *name) {
+  static const struct {
+    const char *name;
+    PatchButtonId id;
+  } names[] = {
+    {"BYPASS_BUTTON", BYPASS_BUTTON}, {"PUSHBUTTON", PUSHBUTTON}, {"GREEN_BUTTON", GREEN_BUTTON}, {"RED_BUTTON", RED_BUTTON},
+    {"BUTTON_A", BUTTON_A}, {"BUTTON_B", BUTTON_B}, {"BUTTON_C", BUTTON_C}, {"BUTTON_D", BUTTON_D},
+    {"BUTTON_E", BUTTON_E}, {"BUTTON_F", BUTTON_F}, {"BUTTON_G", BUTTON_G}, {"BUTTON_H", BUTTON_H},
+  };
+  for(size_t c = 0; c < sizeof(names)/sizeof(names[0]); c++)
+    if (!strcasecmp(name, names[c].name))
+      return names[c].id;
+  return -1;
+}
+
+Automation::Track &Automation::trackFor(int id) {
+  for(size_t c = 0; c < tracks.size(); c++)
+    if (tracks[c].id == id)
+      return tracks[c];
+  Track t;
+  t.id = id;
+  t.cursor = 0;
+  tracks.push_back(t);
+  return tracks.back();
+}
+
+bool Automation::load(const char *path, float sampleRate) {
+  FILE *f = fopen(path, "r");
+  if (!f) return fail(std::string("couldn't open ") + path);
+  char line[256];
+  int lineNo = 0;
+  while (fgets(line, sizeof(line), f)) {
+    lineNo++;
+    char *p = line;
+    while (isspace((unsigned char)*p)) p++;
+    if (!*p || *p == '#') continue;
+    char timeStr[64], name[16];
+    float value;
+    if (sscanf(p, " %63[^, ] , %15[^, ] , %f", timeStr, name, &value) != 3) {
+      fclose(f);
+      return fail("line " + std::to_string(lineNo) + ": expected time,parameter,value");
+    }
+    char *end;
+    double t = strtod(timeStr, &end);
+    if (*end == 's')
+      t *= sampleRate;
+    else if (*end)
+      t = -1;
+    int id = parameterIdFromName(name);
+    int button = id < 0 ? buttonIdFromName(name) : -1;
+    if (t < 0 || (id < 0 && button < 0)) {
+      fclose(f);
+      return fail("line " + std::to_string(lineNo) + ": bad time or parameter name");
+    }
+    if (button >= 0) {
+      float v = value < 0 ? 0 : (value > 1 ? 1 : value);
+      Button b = {(int)(t + 0.5), (PatchButtonId)button, (uint16_t)(v*4095 + 0.5f)};
+      buttons.push_back(b);
+      continue;
+    }
+    Point pt = {(int)(t + 0.5), value};
+    trackFor(id).points.push_back(pt);
+  }
+  fclose(f);
+  std::stable_sort(buttons.begin(), buttons.end(), buttonEarlier);
+  for(size_t c = 0; c < tracks.size(); c++)
+    std::stable_sort(tracks[c].points.begin(), tracks[c].points.end(), pointEarlier);
+  return true;
+}
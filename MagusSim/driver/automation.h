@@ -0,0 +1,94 @@
+#ifndef __driver_automation_hpp__
+#define __driver_automation_hpp__
+
+// Parameter automation for MagusSim. Reads breakpoints from a CSV file and moves the
+// patch's knobs/CV inputs once per block, linearly interpolating between breakpoints.
+//
+// One breakpoint per line: time,parameter,value
+//   time      sample offset, or seconds with an "s" suffix (1.5s)
+//   parameter A-H, AA-DH as on the OWL, or the PatchParameterId number
+//             or a button: PUSHBUTTON, BYPASS_BUTTON, GREEN_BUTTON, RED_BUTTON, BUTTON_A-BUTTON_H
+//   value     0..1; for buttons 1 is pressed, and the value is passed on scaled to 0..4095
+// Buttons are not interpolated; buttonChanged is called once per breakpoint.
+// Blank lines and lines starting with # are ignored.
+// License https://creativecommons.org/publicdomain/zero/1.0/
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "__SIM_INCLUDE.h"
+
+// Convert "A", "DH", "12" etc to a PatchParameterId; -1 if not recognized
+int parameterIdFromName(const char *name);
+
+// Convert "PUSHBUTTON", "BUTTON_C" etc to a PatchButtonId; -1 if not recognized
+int buttonIdFromName(const char *name);
+
+class Automation {
+  struct Point {
+    int at;
+    float value;
+  };
+  static bool pointEarlier(const Point &a, const Point &b) { return a.at < b.at; }
+  struct Track {
+    int id;
+    std::vector<Point> points;
+    size_t cursor; // Index of the last point at or before the current time
+  };
+  std::vector<Track> tracks;
+  struct Button {
+    int at;
+    PatchButtonId id;
+    uint16_t value;
+  };
+  static bool buttonEarlier(const Button &a, const Button &b) { return a.at < b.at; }
+  std::vector<Button> buttons;
+  size_t buttonCursor; // Next button change to deliver
+  std::string error;
+
+  bool fail(const std::string &why) {
+    error = why;
+    return false;
+  }
+
+  Track &trackFor(int id);
+
+public:
+  Automation() : buttonCursor(0) {}
+
+  const std::string &getError() { return error; }
+  bool empty() { return tracks.empty() && buttons.empty(); }
+
+  bool load(const char *path, float sampleRate);
+
+  // Set every automated parameter to its value at sample offset "at". Times must not go backward.
+  void apply(Patch &patch, int at) {
+    for(size_t c = 0; c < tracks.size(); c++) {
+      Track &t = tracks[c];
+      while (t.cursor+1 < t.points.size() && t.points[t.cursor+1].at <= at)
+        t.cursor++;
+      const Point &p = t.points[t.cursor];
+      float value = p.value;
+      if (at > p.at && t.cursor+1 < t.points.size()) {
+        const Point &n = t.points[t.cursor+1];
+        value += (n.value - p.value) * (float)(at - p.at) / (n.at - p.at);
+      }
+      if ((int)patch._parameters.size() <= t.id) // Not registered by the patch, but the host can still set it
+        patch._parameters.resize(t.id + 1);
+      patch._parameters[t.id] = value;
+    }
+  }
+
+  // Take the next button change due before sample "end", if any. Times must not go backward.
+  bool nextButton(int end, int &at, PatchButtonId &id, uint16_t &value) {
+    if (buttonCursor >= buttons.size() || buttons[buttonCursor].at >= end)
+      return false;
+    const Button &b = buttons[buttonCursor++];
+    at = b.at;
+    id = b.id;
+    value = b.value;
+    return true;
+  }
+};
+
+#endif // __driver_automation_hpp__
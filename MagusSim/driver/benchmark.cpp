@@ -0,0 +1,64 @@
+// Per-block timing for the MagusSim --bench mode.
+// License https://creativecommons.org/publicdomain/zero/1.0/
+
+#include <algorithm>
+#include "driver/benchmark.h"
+
+uint64_t BlockTimes::percentile(std::vector<uint64_t> sorted, double p) {
+  if (sorted.empty()) return 0;
+  size_t at = (size_t)(p*(sorted.size()-1) + 0.5);
+  std::nth_element(sorted.begin(), sorted.begin()+at, sorted.end());
+  return sorted[at];
+}
+
+void BlockTimes::report(FILE *out, const char *name, float sampleRate, int blockSize) const {
+  uint64_t total = 0, lo = UINT64_MAX, hi = 0;
+  for(size_t c = 0; c < ns.size(); c++) {
+    total += ns[c];
+    lo = std::min(lo, ns[c]);
+    hi = std::max(hi, ns[c]);
+  }
+  if (ns.empty()) lo = 0;
+  double budget = blockSize * 1e9 / sampleRate;
+  double realtime = samples * 1e9 / sampleRate;
+
+  fprintf(out, "%s: %llu samples in %zu blocks of %d at %g Hz\n", name,
+    (unsigned long long)samples, ns.size(), blockSize, sampleRate);
+  fprintf(out, "  ns/sample  %12.2f\n", samples ? (double)total/samples : 0.0);
+  fprintf(out, "  ns/block   %12.2f\n", ns.size() ? (double)total/ns.size() : 0.0);
+  fprintf(out, "  block ns   min %llu  median %llu  p99 %llu  max %llu\n",
+    (unsigned long long)lo, (unsigned long long)percentile(ns, 0.5),
+    (unsigned long long)percentile(ns, 0.99), (unsigned long long)hi);
+  fprintf(out, "  budget     %.0f ns/block; %.2f%% used on average, %.2f%% in the worst block\n",
+    budget, realtime > 0 ? 100.0*total/realtime : 0.0, 100.0*hi/budget);
+}
+
+void BlockTimes::reportCalls(FILE *out, const char *name) const {
+  uint64_t total = 0;
+  for(size_t c = 0; c < ns.size(); c++)
+    total += ns[c];
+  std::vector<uint64_t> sorted(ns);
+  std::sort(sorted.begin(), sorted.end());
+  fprintf(out, "  %s: %zu calls, mean %.0f ns  min %llu  median %llu  max %llu\n", name, ns.size(),
+    ns.size() ? (double)total/ns.size() : 0.0, (unsigned long long)(sorted.empty() ? 0 : sorted.front()),
+    (unsigned long long)percentile(ns, 0.5), (unsigned long long)(sorted.empty() ? 0 : sorted.back()));
+}
+
+static bool slowerFirst(const std::pair<uint64_t, size_t> &a, const std::pair<uint64_t, size_t> &b) {
+  return a.first > b.first || (a.first == b.first && a.second < b.second);
+}
+
+void BlockTimes::reportWorst(FILE *out, size_t count, float sampleRate, int blockSize) const {
+  std::vector<std::pair<uint64_t, size_t> > byTime;
+  for(size_t c = 0; c < ns.size(); c++)
+    byTime.push_back(std::make_pair(ns[c], c));
+  count = std::min(count, byTime.size());
+  std::partial_sort(byTime.begin(), byTime.begin() + count, byTime.end(), slowerFirst);
+  double budget = blockSize * 1e9 / sampleRate;
+  fprintf(out, "  worst blocks:\n");
+  for(size_t c = 0; c < count; c++) {
+    size_t at = byTime[c].second * blockSize;
+    fprintf(out, "    sample %10zu (%8.3f s) %10llu ns  %6.2f%% of deadline%s\n", at, at/sampleRate,
+      (unsigned long long)byTime[c].first, 100.0*byTime[c].first/budget, byTime[c].first > budget ? "  OVER" : "");
+  }
+}
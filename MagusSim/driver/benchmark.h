@@ -0,0 +1,43 @@
+#ifndef __driver_benchmark_hpp__
+#define __driver_benchmark_hpp__
+
+// Per-block timing for the MagusSim --bench mode.
+// License https://creativecommons.org/publicdomain/zero/1.0/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <chrono>
+#include <vector>
+
+typedef std::chrono::steady_clock BenchClock;
+
+static inline uint64_t benchNs(BenchClock::time_point from, BenchClock::time_point to) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(to - from).count();
+}
+
+struct BlockTimes {
+  std::vector<uint64_t> ns; // One entry per block, in order
+  uint64_t samples;
+
+  BlockTimes() : samples(0) {}
+
+  void reserve(size_t blocks) { ns.reserve(blocks); }
+  void add(uint64_t blockNs, int blockSamples) {
+    ns.push_back(blockNs);
+    samples += blockSamples;
+  }
+
+  // Value at fraction p (0..1) of the sorted times. Sorts a copy.
+  static uint64_t percentile(std::vector<uint64_t> sorted, double p);
+
+  // Print a summary. Budget is the wall time one block represents at the given rate.
+  void report(FILE *out, const char *name, float sampleRate, int blockSize) const;
+
+  // Summary for calls that aren't tied to a number of samples
+  void reportCalls(FILE *out, const char *name) const;
+
+  // The slowest blocks, by sample offset. Assumes every block but the last was blockSize long.
+  void reportWorst(FILE *out, size_t count, float sampleRate, int blockSize) const;
+};
+
+#endif // __driver_benchmark_hpp__
@@ -0,0 +1,107 @@
+// Patch chains for MagusSim.
+// License https://creativecommons.org/publicdomain/zero/1.0/
+
+#include <string.h>
+#include <algorithm>
+#include "driver/chain.h"
+
+bool SimChain::parse(const char *names, const std::vector<SimEvent> &events, bool _midiToAll) {
+  midiToAll = _midiToAll;
+  stages.clear();
+  name.clear();
+  std::string rest = names;
+  while (true) {
+    size_t comma = rest.find(',');
+    std::string stageName = rest.substr(0, comma);
+    const SimPatchEntry *entry = SimPatchRegistry::find(stageName.c_str());
+    if (!entry) {
+      error = "No patch named " + stageName;
+      return false;
+    }
+    stages.push_back(SimChainStage(entry, stages.empty() || midiToAll ? events : noEvents));
+    if (!name.empty()) name += ",";
+    name += entry->name;
+    if (comma == std::string::npos)
+      break;
+    rest = rest.substr(comma + 1);
+  }
+  return true;
+}
+
+void SimChain::setAutomation(const Automation &automation) {
+  for(size_t c = 0; c < stages.size(); c++) {
+    stages[c].automation = automation;
+    stages[c].automated = true;
+  }
+}
+
+bool SimChain::create() {
+  for(size_t c = 0; c < stages.size(); c++) {
+    stages[c].patch = stages[c].entry->create();
+    if (!stages[c].patch) {
+      error = std::string("Couldn't allocate ") + stages[c].entry->name;
+      return false;
+    }
+  }
+  return true;
+}
+
+void SimChain::destroy() {
+  for(size_t c = stages.size(); c-- > 0;) {
+    if (stages[c].patch)
+      stages[c].entry->destroy(stages[c].patch);
+    stages[c].patch = NULL;
+  }
+}
+
+void SimChain::processBlock(AudioBuffer &buffer, int off, int count, int blockSize, bool timed) {
+  for(size_t c = 0; c < stages.size(); c++) {
+    SimChainStage &s = stages[c];
+    BenchClock::time_point start;
+    if (timed) start = BenchClock::now();
+    simProcessBlock(*s.patch, buffer, off, count, blockSize, s.midi, s.automated ? &s.automation : NULL);
+    if (timed) s.times.add(benchNs(start, BenchClock::now()), count);
+  }
+}
+
+void SimChain::processMidi(MidiMessage msg) {
+  for(size_t c = 0; c < (midiToAll ? stages.size() : 1); c++)
+    simProcessMidi(*stages[c].patch, msg);
+}
+
+MonochromeScreenPatch *SimChain::screenPatch() {
+  for(size_t c = 0; c < stages.size(); c++) {
+    MonochromeScreenPatch *screen = dynamic_cast<MonochromeScreenPatch *>(stages[c].patch);
+    if (screen)
+      return screen;
+  }
+  return NULL;
+}
+
+size_t SimChain::patchBytes() {
+  size_t total = 0;
+  for(size_t c = 0; c < stages.size(); c++)
+    total += stages[c].entry->size;
+  return total;
+}
+
+void SimChain::report(FILE *out, float sampleRate, int blockSize) {
+  uint64_t chainNs = 0;
+  for(size_t c = 0; c < stages.size(); c++)
+    for(size_t b = 0; b < stages[c].times.ns.size(); b++)
+      chainNs += stages[c].times.ns[b];
+  double budget = blockSize * 1e9 / sampleRate;
+  fprintf(out, "  stages (%s MIDI):\n", midiToAll ? "every stage gets" : "the first stage gets");
+  for(size_t c = 0; c < stages.size(); c++) {
+    const BlockTimes &t = stages[c].times;
+    uint64_t total = 0, hi = 0;
+    for(size_t b = 0; b < t.ns.size(); b++) {
+      total += t.ns[b];
+      hi = std::max(hi, t.ns[b]);
+    }
+    fprintf(out, "    %zu %-20s ns/sample %10.2f  median %8llu  max %8llu ns/block  %5.1f%% of the chain, worst block %.2f%% of budget\n",
+      c + 1, stages[c].entry->name, t.samples ? (double)total/t.samples : 0.0,
+      (unsigned long long)BlockTimes::percentile(t.ns, 0.5), (unsigned long long)hi,
+      chainNs ? 100.0*total/chainNs : 0.0, 100.0*hi/budget);
+  }
+}
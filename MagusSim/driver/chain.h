@@ -0,0 +1,68 @@
+#ifndef __driver_chain_hpp__
+#define __driver_chain_hpp__
+
+// Patches run in series for --patch A,B,..., as a source feeding effects on stage. Every
+// stage processes the same AudioBuffer in place, so one stage's output is the next stage's
+// input with nothing copied between them. Each stage has its own place in the MIDI queue
+// and the automation, and its own share of each block's time for --bench.
+// License https://creativecommons.org/publicdomain/zero/1.0/
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "driver/registry.h"
+#include "driver/render.h"
+#include "driver/benchmark.h"
+
+struct SimChainStage {
+  const SimPatchEntry *entry;
+  Patch *patch;
+  SimEventCursor midi;
+  Automation automation; // A copy, as automation keeps track of how far it has played
+  bool automated;
+  BlockTimes times;
+
+  SimChainStage(const SimPatchEntry *_entry, const std::vector<SimEvent> &events)
+    : entry(_entry), patch(NULL), midi(events), automated(false) {}
+};
+
+class SimChain {
+  std::vector<SimChainStage> stages;
+  std::vector<SimEvent> noEvents; // Queue for stages that don't get MIDI
+  bool midiToAll;
+  std::string name, error;
+
+public:
+  SimChain() : midiToAll(false) {}
+
+  const std::string &getError() { return error; }
+  const char *getName() { return name.c_str(); } // The stages' class names, joined by ","
+  size_t size() { return stages.size(); }
+  const SimPatchEntry *entry(size_t stage) { return stages[stage].entry; }
+  Patch &patch(size_t stage) { return *stages[stage].patch; }
+
+  // Look up comma separated patch names, eg "Saw4,PureDelay", in the order they run.
+  // The first stage gets the MIDI in events, or every stage does with midiToAll.
+  bool parse(const char *names, const std::vector<SimEvent> &events, bool midiToAll);
+  void setAutomation(const Automation &automation);
+
+  // Construct every stage in order. False with getError() if one can't be allocated.
+  bool create();
+  void destroy(); // In reverse order, as the stages were built
+
+  // Times each stage into its BlockTimes if timed. See simProcessBlock.
+  void processBlock(AudioBuffer &buffer, int off, int count, int blockSize, bool timed);
+
+  // Deliver a live message to the stages that get MIDI
+  void processMidi(MidiMessage msg);
+
+  // The first stage that draws on the screen, as the device only has one; NULL if none
+  MonochromeScreenPatch *screenPatch();
+
+  size_t patchBytes(); // Total size of the patch objects
+
+  // Each stage's share of the time, with its median and worst block against the budget
+  void report(FILE *out, float sampleRate, int blockSize);
+};
+
+#endif // __driver_chain_hpp__
@@ -0,0 +1,47 @@
+// Output digests for MagusSim.
+// License https://creativecommons.org/publicdomain/zero/1.0/
+
+#include <string.h>
+#include <math.h>
+#include "driver/digest.h"
+
+// One multiply and shift per stereo frame, so hashing keeps up with the patch. Every step
+// is invertible, so no single changed sample can be lost.
+static inline uint64_t mixFrame(uint64_t hash, uint32_t left, uint32_t right) {
+  hash = (hash ^ (((uint64_t)right << 32) | left)) * 0x9E3779B97F4A7C15ULL;
+  return hash ^ (hash >> 29);
+}
+
+void AudioDigest::add(const float *left, const float *right, size_t count) {
+  uint64_t h = hash;
+  double sum = 0;
+  float hi = peak;
+  for(size_t c = 0; c < count; c++) {
+    uint32_t l, r;
+    memcpy(&l, &left[c], 4);
+    memcpy(&r, &right[c], 4);
+    h = mixFrame(h, l, r); // Hashes the bit patterns as integers, so digests don't depend on byte order
+    float s[2] = {left[c], right[c]};
+    for(int side = 0; side < 2; side++) {
+      if (!isfinite(s[side])) {
+        nonFinite++;
+        continue;
+      }
+      sum += (double)s[side]*s[side];
+      float a = fabsf(s[side]);
+      if (a > hi) hi = a;
+    }
+  }
+  hash = h;
+  sumSquares += sum;
+  peak = hi;
+  frames += count;
+}
+
+double AudioDigest::getRms() const {
+  return frames ? sqrt(sumSquares / (2.0*frames)) : 0;
+}
+
+void AudioDigest::format(char *out, size_t size) const {
+  snprintf(out, size, "%016llx %.6f %.6f", (unsigned long long)hash, peak, getRms());
+}
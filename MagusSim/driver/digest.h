@@ -0,0 +1,34 @@
+#ifndef __driver_digest_hpp__
+#define __driver_digest_hpp__
+
+// Running summary of a patch's output for MagusSim: a hash of the exact sample bits,
+// so two runs can be compared without keeping the audio, plus peak and RMS level.
+// License https://creativecommons.org/publicdomain/zero/1.0/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+class AudioDigest {
+  uint64_t hash;    // Over the float bits of each stereo frame in turn
+  double sumSquares;
+  float peak;
+  uint64_t frames;
+  uint64_t nonFinite; // NaN and infinite samples, which are left out of peak and RMS
+
+public:
+  AudioDigest() : hash(14695981039346656037ULL), sumSquares(0), peak(0), frames(0), nonFinite(0) {}
+
+  void add(const float *left, const float *right, size_t count);
+
+  uint64_t getHash() const { return hash; }
+  float getPeak() const { return peak; }
+  double getRms() const;
+  uint64_t getFrames() const { return frames; }
+  uint64_t getNonFinite() const { return nonFinite; }
+
+  // "hash peak rms", as written to results files
+  void format(char *out, size_t size) const;
+};
+
+#endif // __driver_digest_hpp__
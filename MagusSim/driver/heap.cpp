@@ -0,0 +1,210 @@
+// Heap accounting for MagusSim.
+// License https://creativecommons.org/publicdomain/zero/1.0/
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <atomic>
+#include <mutex>
+#include "driver/heap.h"
+
+thread_local bool simHeapTracking = false;
+thread_local bool simHeapEnabled = true;
+
+static std::atomic<uint64_t> allocations(0), frees(0), bytes(0);
+static std::atomic<int64_t> live(0), peakLive(0);
+
+static void counted(size_t size) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  bytes.fetch_add(size, std::memory_order_relaxed);
+  int64_t now = live.fetch_add(size, std::memory_order_relaxed) + size;
+  int64_t peak = peakLive.load(std::memory_order_relaxed);
+  while (now > peak && !peakLive.compare_exchange_weak(peak, now, std::memory_order_relaxed)) {}
+}
+
+static void uncounted(size_t size) {
+  frees.fetch_add(1, std::memory_order_relaxed);
+  live.fetch_sub(size, std::memory_order_relaxed);
+}
+
+SimHeapCounts simHeapPhase() {
+  SimHeapCounts c;
+  c.allocations = allocations.exchange(0);
+  c.frees = frees.exchange(0);
+  c.bytes = bytes.exchange(0);
+  c.live = live.load();
+  c.peakLive = peakLive.exchange(c.live);
+  return c;
+}
+
+void simHeapReport(FILE *out, const char *phase, const SimHeapCounts &c) {
+  fprintf(out, "  heap during %s: %llu allocations (%llu bytes), %llu frees, %lld bytes live after, peak %lld live\n",
+    phase, (unsigned long long)c.allocations, (unsigned long long)c.bytes, (unsigned long long)c.frees,
+    (long long)c.live, (long long)c.peakLive);
+}
+
+#ifdef __GLIBC__
+
+// glibc's own allocator, which the wrappers below pass through to
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *p, size_t size);
+void *__libc_memalign(size_t align, size_t size);
+void __libc_free(void *p);
+size_t malloc_usable_size(void *p);
+}
+
+// Blocks allocated while tracking, so a free is only counted for those: the simulator's own
+// buffers can be freed while a scope is open and the patch's after it closes. An open
+// addressing table from the unwrapped allocator, as it can't call malloc itself.
+struct TrackedBlock {
+  void *p; // NULL for empty, tombstone for removed
+  size_t size;
+};
+static TrackedBlock *tracked = NULL;
+static size_t trackedCapacity = 0, trackedUsed = 0; // Used counts tombstones
+static std::atomic<size_t> trackedLive(0);
+static std::mutex trackedLock;
+static char tombstoneByte;
+#define TOMBSTONE ((void *)&tombstoneByte)
+
+static size_t trackedSlot(void *p) {
+  uintptr_t h = (uintptr_t)p >> 4;
+  return (h ^ (h >> 17)) & (trackedCapacity - 1);
+}
+
+static TrackedBlock *trackedFind(void *p) {
+  for(size_t c = trackedSlot(p);; c = (c + 1) & (trackedCapacity - 1)) {
+    if (tracked[c].p == p) return &tracked[c];
+    if (!tracked[c].p) return NULL;
+  }
+}
+
+// Caller holds trackedLock. False if the table can't grow, and then the block goes uncounted.
+static bool trackedInsert(void *p, size_t size) {
+  if ((trackedUsed + 1)*2 > trackedCapacity) {
+    size_t live = trackedLive.load(std::memory_order_relaxed), capacity = 256;
+    while ((live + 1)*4 > capacity) capacity *= 2;
+    TrackedBlock *grown = (TrackedBlock *)__libc_calloc(capacity, sizeof(TrackedBlock));
+    if (!grown) return false;
+    TrackedBlock *was = tracked;
+    size_t wasCapacity = trackedCapacity;
+    tracked = grown;
+    trackedCapacity = capacity;
+    trackedUsed = 0;
+    for(size_t c = 0; c < wasCapacity; c++)
+      if (was[c].p && was[c].p != TOMBSTONE) {
+        size_t at = trackedSlot(was[c].p);
+        while (tracked[at].p) at = (at + 1) & (trackedCapacity - 1);
+        tracked[at] = was[c];
+        trackedUsed++;
+      }
+    __libc_free(was);
+  }
+  size_t at = trackedSlot(p);
+  while (tracked[at].p && tracked[at].p != TOMBSTONE) at = (at + 1) & (trackedCapacity - 1);
+  if (!tracked[at].p) trackedUsed++;
+  tracked[at].p = p;
+  tracked[at].size = size;
+  trackedLive.fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+static void track(void *p) {
+  size_t size = malloc_usable_size(p);
+  std::lock_guard<std::mutex> hold(trackedLock);
+  if (trackedInsert(p, size))
+    counted(size);
+}
+
+// Count freeing p if it was allocated while tracking. Caller holds trackedLock.
+static void forget(void *p) {
+  TrackedBlock *block = trackedFind(p);
+  if (!block)
+    return;
+  uncounted(block->size);
+  block->p = TOMBSTONE;
+  trackedLive.fetch_sub(1, std::memory_order_relaxed);
+}
+
+extern "C" {
+void *malloc(size_t size) {
+  void *p = __libc_malloc(size);
+  if (p && simHeapTracking) track(p);
+  return p;
+}
+
+void *calloc(size_t count, size_t size) {
+  void *p = __libc_calloc(count, size);
+  if (p && simHeapTracking) track(p);
+  return p;
+}
+
+void *realloc(void *old, size_t size) {
+  void *p;
+  if (old && trackedLive.load(std::memory_order_relaxed)) {
+    // Held across the realloc, so another thread can't be handed old's address and track it first
+    std::lock_guard<std::mutex> hold(trackedLock);
+    p = __libc_realloc(old, size);
+    if (p || !size) forget(old); // Moved or freed; a failed realloc leaves old as it was
+  } else {
+    p = __libc_realloc(old, size);
+  }
+  if (p && simHeapTracking) track(p);
+  return p;
+}
+
+void *memalign(size_t align, size_t size) {
+  void *p = __libc_memalign(align, size);
+  if (p && simHeapTracking) track(p);
+  return p;
+}
+
+void *aligned_alloc(size_t align, size_t size) {
+  return memalign(align, size);
+}
+
+int posix_memalign(void **out, size_t align, size_t size) {
+  if (align < sizeof(void *) || (align & (align - 1)))
+    return EINVAL;
+  void *p = memalign(align, size);
+  if (!p)
+    return ENOMEM;
+  *out = p;
+  return 0;
+}
+
+void free(void *p) {
+  if (p && trackedLive.load(std::memory_order_relaxed)) { // Nothing is tracked, so every free outside a run skips the lock
+    std::lock_guard<std::mutex> hold(trackedLock);
+    forget(p);
+  }
+  __libc_free(p);
+}
+}
+
+bool simHeapAvailable() { return true; }
+
+void *simPatchStorageAlloc(size_t size, size_t align) {
+  return __libc_memalign(align < 64 ? 64 : align, size);
+}
+
+void simPatchStorageFree(void *storage) {
+  __libc_free(storage);
+}
+
+#else
+
+bool simHeapAvailable() { return false; }
+
+void *simPatchStorageAlloc(size_t size, size_t align) {
+  void *p = NULL;
+  return posix_memalign(&p, align < 64 ? 64 : align, size) ? NULL : p;
+}
+
+void simPatchStorageFree(void *storage) {
+  free(storage);
+}
+
+#endif
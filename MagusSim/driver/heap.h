@@ -0,0 +1,47 @@
+#ifndef __driver_heap_hpp__
+#define __driver_heap_hpp__
+
+// Heap accounting for MagusSim. malloc and friends (and so new and delete) are wrapped to
+// count what the patch allocates: only allocations made while a SimHeapScope is open on the
+// calling thread are counted, and then their frees wherever they happen, so the simulator's
+// own buffers stay out of the numbers.
+// Needs glibc, which lets a program replace malloc; elsewhere nothing is counted.
+// License https://creativecommons.org/publicdomain/zero/1.0/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+struct SimHeapCounts {
+  uint64_t allocations, frees;
+  uint64_t bytes;     // Total allocated in this phase
+  int64_t live;       // Allocated and not yet freed, across all phases
+  int64_t peakLive;   // Highest "live" seen in this phase
+};
+
+extern thread_local bool simHeapTracking;
+
+// Clear to never track on this thread. Sweep workers do, as the accounting takes a lock that
+// every free in the process would then contend on.
+extern thread_local bool simHeapEnabled;
+
+// Count allocations made on this thread while this is in scope
+class SimHeapScope {
+  bool was;
+public:
+  SimHeapScope(bool track = true) : was(simHeapTracking) { simHeapTracking = track && simHeapEnabled; }
+  ~SimHeapScope() { simHeapTracking = was; }
+};
+
+// False if this platform can't replace malloc, so every count stays zero
+bool simHeapAvailable();
+
+// Counts since the last phase began. Starting a phase zeroes the counts except "live".
+SimHeapCounts simHeapPhase();
+void simHeapReport(FILE *out, const char *phase, const SimHeapCounts &counts);
+
+// Storage for a patch: aligned to at least a cache line, from the unwrapped allocator
+void *simPatchStorageAlloc(size_t size, size_t align);
+void simPatchStorageFree(void *storage);
+
+#endif // __driver_heap_hpp__
@@ -0,0 +1,88 @@
+// Latency histograms for MagusSim.
+// License https://creativecommons.org/publicdomain/zero/1.0/
+
+#include <string.h>
+#include "driver/histogram.h"
+
+LatencyHistogram::LatencyHistogram() : counts((MAX_BITS - SUB_BITS + 1) * SUB_COUNT, 0), total(0), lo(UINT64_MAX), hi(0), sum(0) {}
+
+int LatencyHistogram::bucketFor(uint64_t v) {
+  if (v < (uint64_t)SUB_COUNT)
+    return (int)v;
+  int bits = 63 - __builtin_clzll(v);
+  if (bits >= MAX_BITS)
+    return (MAX_BITS - SUB_BITS + 1) * SUB_COUNT - 1;
+  int shift = bits - SUB_BITS;
+  return (shift + 1)*SUB_COUNT + (int)((v >> shift) - SUB_COUNT);
+}
+
+uint64_t LatencyHistogram::bucketLow(int bucket) {
+  if (bucket < SUB_COUNT)
+    return bucket;
+  int shift = bucket/SUB_COUNT - 1;
+  return (uint64_t)(SUB_COUNT + bucket%SUB_COUNT) << shift;
+}
+
+uint64_t LatencyHistogram::bucketHigh(int bucket) {
+  if (bucket < SUB_COUNT)
+    return bucket;
+  int shift = bucket/SUB_COUNT - 1;
+  return bucketLow(bucket) + ((uint64_t)1 << shift) - 1;
+}
+
+uint64_t LatencyHistogram::percentile(double p) const {
+  if (!total)
+    return 0;
+  uint64_t want = (uint64_t)(p*total + 0.5);
+  if (want < 1) want = 1;
+  uint64_t seen = 0;
+  for(size_t c = 0; c < counts.size(); c++) {
+    seen += counts[c];
+    if (seen >= want) {
+      uint64_t v = bucketHigh((int)c);
+      return v < hi ? v : hi;
+    }
+  }
+  return hi;
+}
+
+void LatencyHistogram::report(FILE *out, const char *name, double deadlineNs, bool brief) const {
+  fprintf(out, "  %s: %llu calls, ns mean %.0f  min %llu  p50 %llu  p90 %llu  p99 %llu  p99.9 %llu  max %llu  jitter(p99-p50) %llu\n",
+    name, (unsigned long long)total, mean(), (unsigned long long)min(),
+    (unsigned long long)percentile(0.5), (unsigned long long)percentile(0.9), (unsigned long long)percentile(0.99),
+    (unsigned long long)percentile(0.999), (unsigned long long)hi,
+    (unsigned long long)(percentile(0.99) - percentile(0.5)));
+  if (deadlineNs > 0) {
+    uint64_t over = 0;
+    for(size_t c = 0; c < counts.size(); c++)
+      if (bucketLow((int)c) > deadlineNs)
+        over += counts[c];
+    fprintf(out, "    %llu over the %.0f ns deadline, worst at %.1f%% of it\n",
+      (unsigned long long)over, deadlineNs, 100.0*hi/deadlineNs);
+  }
+  if (brief || !total)
+    return;
+
+  // Fold the fine buckets into one row per power of two
+  uint64_t rows[MAX_BITS + 1];
+  memset(rows, 0, sizeof(rows));
+  uint64_t widest = 0;
+  for(size_t c = 0; c < counts.size(); c++) {
+    if (!counts[c]) continue;
+    uint64_t low = bucketLow((int)c);
+    int row = low ? 63 - __builtin_clzll(low) + 1 : 0; // Row r holds [2^(r-1), 2^r)
+    rows[row] += counts[c];
+    if (rows[row] > widest) widest = rows[row];
+  }
+  int first = 0, last = MAX_BITS;
+  while (!rows[first]) first++;
+  while (!rows[last]) last--;
+  for(int r = first; r <= last; r++) {
+    char bar[41];
+    int width = (int)(40*rows[r]/widest);
+    if (rows[r] && !width) width = 1;
+    memset(bar, '#', width);
+    bar[width] = '\0';
+    fprintf(out, "    < %12llu ns %10llu %s\n", (unsigned long long)((uint64_t)1 << r), (unsigned long long)rows[r], bar);
+  }
+}
@@ -0,0 +1,48 @@
+#ifndef __driver_histogram_hpp__
+#define __driver_histogram_hpp__
+
+// HDR-style latency histogram for MagusSim: log-linear buckets, 128 per power of two, so
+// any recorded time is kept to within 1% whether it is 50 ns or 50 ms. Recording is a few
+// instructions and never allocates, so it can run around every patch callback.
+// License https://creativecommons.org/publicdomain/zero/1.0/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+
+class LatencyHistogram {
+  static const int SUB_BITS = 7;
+  static const int SUB_COUNT = 1 << SUB_BITS;
+  static const int MAX_BITS = 40; // Times past 2^40 ns (18 minutes) are clamped
+
+  std::vector<uint64_t> counts;
+  uint64_t total, lo, hi;
+  double sum;
+
+  static int bucketFor(uint64_t v);
+  static uint64_t bucketLow(int bucket);
+  static uint64_t bucketHigh(int bucket); // Largest value that lands in this bucket
+
+public:
+  LatencyHistogram();
+
+  void record(uint64_t ns) {
+    counts[bucketFor(ns)]++;
+    total++;
+    sum += ns;
+    if (ns < lo) lo = ns;
+    if (ns > hi) hi = ns;
+  }
+
+  uint64_t count() const { return total; }
+  uint64_t min() const { return total ? lo : 0; }
+  uint64_t max() const { return hi; }
+  double mean() const { return total ? sum/total : 0; }
+  uint64_t percentile(double p) const; // p is 0..1
+
+  // One summary line, then unless brief a bar per power of two that has any calls.
+  // With a deadline, also counts the calls over it.
+  void report(FILE *out, const char *name, double deadlineNs = 0, bool brief = false) const;
+};
+
+#endif // __driver_histogram_hpp__
@@ -0,0 +1,175 @@
+// Standard MIDI File reading and writing for MagusSim.
+// License https://creativecommons.org/publicdomain/zero/1.0/
+
+#include <string.h>
+#include <algorithm>
+#include "driver/midiFile.h"
+
+static bool simEventEarlier(const SimEvent &a, const SimEvent &b) {
+  return a.at < b.at;
+}
+
+void sortSimEvents(std::vector<SimEvent> &events) {
+  std::stable_sort(events.begin(), events.end(), simEventEarlier);
+}
+
+bool MidiFileReader::readTrack(size_t end, std::vector<TickEvent> &events, std::vector<TempoChange> &tempos) {
+  uint32_t tick = 0;
+  uint8_t status = 0; // For running status
+  while (at < end) {
+    uint32_t delta;
+    if (!vlq(delta, end)) return fail("bad delta time");
+    tick += delta;
+    if (at >= end) return fail("truncated track");
+    uint8_t b = data[at];
+    if (b == 0xFF) { // Meta event
+      at++;
+      if (at >= end) return fail("truncated meta event");
+      uint8_t type = data[at++];
+      uint32_t len;
+      if (!vlq(len, end) || at + len > end) return fail("bad meta event length");
+      if (type == 0x51 && len == 3) {
+        TempoChange t = {tick, be(3)};
+        tempos.push_back(t);
+      } else {
+        at += len;
+      }
+      status = 0; // Meta events cancel running status, as sysex does
+      if (type == 0x2F) // End of track
+        break;
+    } else if (b == 0xF0 || b == 0xF7) { // Sysex, skipped; the OWL API never delivers it to processMidi
+      at++;
+      uint32_t len;
+      if (!vlq(len, end) || at + len > end) return fail("bad sysex length");
+      at += len;
+      status = 0;
+    } else if (b > 0xF0) { // System common and realtime don't belong in a file, but skip them as a port would
+      static const int8_t dataBytes[15] = {1, 2, 1, -1, -1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0}; // 0xF1-0xFF; -1 undefined
+      int size = dataBytes[b - 0xF1];
+      if (size < 0) return fail("undefined system status");
+      at++;
+      if (at + size > end) return fail("truncated system message");
+      at += size;
+      if (b < 0xF8) status = 0; // Realtime leaves running status alone
+    } else {
+      if (b & 0x80) {
+        status = b;
+        at++;
+      } else if (!status) {
+        return fail("data byte without status");
+      }
+      uint8_t kind = status & MIDI_STATUS_MASK;
+      int size = (kind == PROGRAM_CHANGE || kind == CHANNEL_PRESSURE) ? 1 : 2;
+      if (at + size > end) return fail("truncated channel message");
+      uint8_t d1 = data[at++];
+      uint8_t d2 = size > 1 ? data[at++] : 0;
+      TickEvent e = {tick, MidiMessage(status >> 4, status, d1, d2)};
+      events.push_back(e);
+    }
+  }
+  at = end;
+  return true;
+}
+
+bool MidiFileReader::read(const char *path, float sampleRate, std::vector<SimEvent> &out) {
+  FILE *f = fopen(path, "rb");
+  if (!f) return fail(std::string("couldn't open ") + path);
+  uint8_t chunk[4096];
+  size_t got;
+  data.clear();
+  while ((got = fread(chunk, 1, sizeof(chunk), f)) > 0)
+    data.insert(data.end(), chunk, chunk+got);
+  fclose(f);
+  at = 0;
+
+  if (!need(14) || memcmp(&data[0], "MThd", 4)) return fail("not a standard MIDI file");
+  at = 4;
+  uint32_t headerLen = be(4);
+  if (headerLen < 6 || !need(headerLen)) return fail("bad header");
+  uint32_t format = be(2);
+  uint32_t trackCount = be(2);
+  uint16_t division = be(2);
+  at = 8 + headerLen;
+  if (format > 1) return fail("only format 0 and 1 files are supported");
+
+  std::vector<TickEvent> events;
+  std::vector<TempoChange> tempos;
+  for(uint32_t t = 0; t < trackCount && need(8); ) {
+    bool isTrack = !memcmp(&data[at], "MTrk", 4);
+    at += 4;
+    uint32_t len = be(4);
+    if (!need(len)) return fail("truncated chunk");
+    if (isTrack) {
+      if (!readTrack(at + len, events, tempos)) return false;
+      t++;
+    } else {
+      at += len; // Unknown chunks must be skipped
+    }
+  }
+  std::stable_sort(events.begin(), events.end(), tickEarlier);
+  std::stable_sort(tempos.begin(), tempos.end(), tempoEarlier);
+
+  // Walk the tempo map alongside the events, accumulating seconds
+  double secondsPerTick;
+  bool smpte = division & 0x8000;
+  if (smpte) { // Fixed frames per second times ticks per frame; tempo does not apply
+    int fps = -(int8_t)(division >> 8);
+    if (fps == 29) fps = 30; // 29.97 drop frame runs at the nominal 30
+    secondsPerTick = 1.0 / (fps * (division & 0xFF));
+  } else {
+    if (!division) return fail("zero ticks per quarter note");
+    secondsPerTick = 500000 / 1e6 / division; // 120 BPM until told otherwise
+  }
+  double seconds = 0;
+  uint32_t lastTick = 0;
+  size_t tempoAt = 0;
+  for(size_t c = 0; c < events.size(); c++) {
+    uint32_t tick = events[c].tick;
+    while (!smpte && tempoAt < tempos.size() && tempos[tempoAt].tick <= tick) {
+      seconds += (tempos[tempoAt].tick - lastTick) * secondsPerTick;
+      lastTick = tempos[tempoAt].tick;
+      secondsPerTick = tempos[tempoAt].usPerQuarter / 1e6 / division;
+      tempoAt++;
+    }
+    seconds += (tick - lastTick) * secondsPerTick;
+    lastTick = tick;
+    out.push_back(SimEvent((int)(seconds*sampleRate + 0.5), events[c].msg));
+  }
+  return true;
+}
+
+bool writeMidiFile(const char *path, const std::vector<SimEvent> &events, float sampleRate) {
+  const uint32_t ppq = 10000;
+  std::vector<uint8_t> track;
+  const uint8_t tempo[] = {0x00, 0xFF, 0x51, 0x03, 0x0F, 0x42, 0x40}; // 1000000 us per quarter
+  track.insert(track.end(), tempo, tempo + sizeof(tempo));
+  uint64_t lastTick = 0;
+  for(size_t c = 0; c < events.size(); c++) {
+    const MidiMessage &msg = events[c].msg;
+    if (!midiIsChannelStatus(msg.data[1]))
+      continue;
+    uint64_t tick = (uint64_t)(events[c].at * (double)ppq / sampleRate + 0.5);
+    uint32_t delta = tick > lastTick ? (uint32_t)(tick - lastTick) : 0;
+    lastTick = tick > lastTick ? tick : lastTick;
+    uint8_t vlq[5];
+    int n = 0;
+    do {
+      vlq[n++] = delta & 0x7F;
+      delta >>= 7;
+    } while (delta);
+    while (n--)
+      track.push_back(vlq[n] | (n ? 0x80 : 0));
+    track.insert(track.end(), msg.data + 1, msg.data + 1 + midiWireLength(msg.data[1]));
+  }
+  const uint8_t end[] = {0x00, 0xFF, 0x2F, 0x00};
+  track.insert(track.end(), end, end + sizeof(end));
+
+  FILE *f = fopen(path, "wb");
+  if (!f) return false;
+  uint32_t len = track.size();
+  const uint8_t header[] = {'M','T','h','d', 0,0,0,6, 0,0, 0,1, ppq >> 8, ppq & 0xFF,
+    'M','T','r','k', (uint8_t)(len >> 24), (uint8_t)(len >> 16), (uint8_t)(len >> 8), (uint8_t)len};
+  bool ok = fwrite(header, 1, sizeof(header), f) == sizeof(header)
+         && fwrite(&track[0], 1, track.size(), f) == track.size();
+  return fclose(f) == 0 && ok;
+}
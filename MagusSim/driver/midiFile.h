@@ -0,0 +1,93 @@
+#ifndef __driver_midiFile_hpp__
+#define __driver_midiFile_hpp__
+
+// Standard MIDI File reader for MagusSim. Flattens all tracks of a format 0 or 1 file
+// into channel messages timestamped in samples, using the file's tempo map.
+// Also writes sample-timestamped messages back out as a format 0 file.
+// License https://creativecommons.org/publicdomain/zero/1.0/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "__SIM_INCLUDE.h"
+
+// A MIDI message due at a given sample offset
+struct SimEvent {
+  int at;
+  MidiMessage msg;
+  SimEvent() : at(0) {}
+  SimEvent(int _at, MidiMessage _msg) : at(_at), msg(_msg) {}
+};
+
+// Sort a queue into dispatch order. Stable, so events at the same sample keep their order.
+void sortSimEvents(std::vector<SimEvent> &events);
+
+class MidiFileReader {
+  struct TickEvent {
+    uint32_t tick;
+    MidiMessage msg;
+  };
+  struct TempoChange {
+    uint32_t tick;
+    uint32_t usPerQuarter;
+  };
+  static bool tickEarlier(const TickEvent &a, const TickEvent &b) { return a.tick < b.tick; }
+  static bool tempoEarlier(const TempoChange &a, const TempoChange &b) { return a.tick < b.tick; }
+
+  std::vector<uint8_t> data;
+  size_t at;
+  std::string error;
+
+  bool fail(const std::string &why) {
+    error = why;
+    return false;
+  }
+  bool need(size_t count) {
+    return at + count <= data.size();
+  }
+  uint32_t be(int bytes) { // Big-endian integer
+    uint32_t v = 0;
+    for(int c = 0; c < bytes; c++)
+      v = (v << 8) | data[at++];
+    return v;
+  }
+  bool vlq(uint32_t &v, size_t end) { // Variable-length quantity
+    v = 0;
+    for(int c = 0; c < 4; c++) {
+      if (at >= end) return false;
+      uint8_t b = data[at++];
+      v = (v << 7) | (b & 0x7F);
+      if (!(b & 0x80)) return true;
+    }
+    return false;
+  }
+
+  bool readTrack(size_t end, std::vector<TickEvent> &events, std::vector<TempoChange> &tempos);
+
+public:
+  const std::string &getError() { return error; }
+
+  // Append every channel message in the file to events. Does not sort the result.
+  bool read(const char *path, float sampleRate, std::vector<SimEvent> &out);
+};
+
+// Channel messages are the only kind MidiMessage can carry whole; anything else a patch
+// sends is skipped when writing
+static inline bool midiIsChannelStatus(uint8_t status) {
+  return status >= 0x80 && status < 0xF0;
+}
+
+// Bytes a channel message takes on a serial MIDI wire (no running status), 0 for anything else
+static inline int midiWireLength(uint8_t status) {
+  if (!midiIsChannelStatus(status))
+    return 0;
+  uint8_t kind = status & MIDI_STATUS_MASK;
+  return (kind == PROGRAM_CHANGE || kind == CHANNEL_PRESSURE) ? 2 : 3;
+}
+
+// Write the channel messages in events (sorted) as a one-track file. Tempo is fixed at one
+// quarter note per second with 10000 ticks per quarter, so ticks are 0.1 ms at any sample rate.
+bool writeMidiFile(const char *path, const std::vector<SimEvent> &events, float sampleRate);
+
+#endif // __driver_midiFile_hpp__
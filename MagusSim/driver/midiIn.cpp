@@ -0,0 +1,120 @@
+// Live MIDI input for MagusSim.
+// License https://creativecommons.org/publicdomain/zero/1.0/
+
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "driver/midiIn.h"
+
+bool LiveMidiInput::open(const char *path, bool _usbPackets) {
+  usbPackets = _usbPackets;
+  struct stat info;
+  if (stat(path, &info))
+    return fail(std::string("couldn't open ") + path + ": " + strerror(errno));
+  if (S_ISSOCK(info.st_mode)) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address.sun_path))
+      return fail(std::string("socket path too long: ") + path);
+    strcpy(address.sun_path, path);
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&address, sizeof(address)))
+      return fail(std::string("couldn't connect to ") + path + ": " + strerror(errno));
+  } else {
+    // Non-blocking so opening a FIFO doesn't wait for a writer
+    fd = ::open(path, O_RDONLY | O_NONBLOCK);
+    if (fd < 0)
+      return fail(std::string("couldn't open ") + path + ": " + strerror(errno));
+    if (S_ISFIFO(info.st_mode))
+      keepOpen = ::open(path, O_WRONLY | O_NONBLOCK);
+  }
+  thread = std::thread(&LiveMidiInput::run, this);
+  return true;
+}
+
+void LiveMidiInput::run() {
+  uint8_t bytes[256];
+  size_t have = 0;
+  while (!stopping.load()) {
+    struct pollfd p = {fd, POLLIN, 0};
+    if (::poll(&p, 1, 50) <= 0) // Wake now and then to see if we should stop
+      continue;
+    ssize_t got = read(fd, bytes + have, sizeof(bytes) - have);
+    if (got < 0 && (errno == EAGAIN || errno == EINTR))
+      continue;
+    if (got <= 0) // End of file, or the socket closed
+      break;
+    BenchClock::time_point now = BenchClock::now();
+    if (usbPackets) {
+      have += got;
+      size_t whole = have & ~(size_t)3;
+      for(size_t c = 0; c < whole; c += 4) {
+        uint8_t cin = bytes[c] & 0x0F;
+        if (cin >= 0x8 && cin <= 0xE)
+          deliver(MidiMessage(bytes[c], bytes[c+1], bytes[c+2], bytes[c+3]), now);
+        else
+          skipped++;
+      }
+      memmove(bytes, bytes + whole, have - whole);
+      have -= whole;
+    } else {
+      parse(bytes, got, now);
+    }
+  }
+}
+
+// Running status is kept; realtime bytes can appear anywhere and are skipped
+void LiveMidiInput::parse(const uint8_t *bytes, size_t count, BenchClock::time_point now) {
+  for(size_t c = 0; c < count; c++) {
+    uint8_t b = bytes[c];
+    if (b >= 0xF8) {
+      skipped++;
+    } else if (b >= 0xF0) { // Sysex and system common cancel running status
+      status = 0;
+      pendingCount = 0;
+      skipped++;
+    } else if (b & 0x80) {
+      status = b;
+      pendingCount = 0;
+    } else if (!status) {
+      skipped++; // Data with no status, eg inside sysex
+    } else {
+      pending[pendingCount++] = b;
+      uint8_t kind = status & MIDI_STATUS_MASK;
+      int size = (kind == PROGRAM_CHANGE || kind == CHANNEL_PRESSURE) ? 1 : 2;
+      if (pendingCount == size) {
+        deliver(MidiMessage(status >> 4, status, pending[0], size > 1 ? pending[1] : 0), now);
+        pendingCount = 0;
+      }
+    }
+  }
+}
+
+void LiveMidiInput::deliver(MidiMessage msg, BenchClock::time_point now) {
+  LiveMidiEvent e = {now, msg};
+  if (!ring.push(e))
+    dropped++;
+}
+
+void LiveMidiInput::poll(std::vector<LiveMidiEvent> &out) {
+  LiveMidiEvent e;
+  while (ring.pop(e))
+    out.push_back(e);
+}
+
+void LiveMidiInput::close() {
+  stopping.store(true);
+  if (thread.joinable())
+    thread.join();
+  if (fd >= 0)
+    ::close(fd);
+  if (keepOpen >= 0)
+    ::close(keepOpen);
+  fd = keepOpen = -1;
+}
@@ -0,0 +1,68 @@
+#ifndef __driver_midiIn_hpp__
+#define __driver_midiIn_hpp__
+
+// Live MIDI input for MagusSim. A reader thread takes raw MIDI bytes or 4-byte USB-MIDI
+// packets from a named pipe, a Unix socket or a file, stamps each message with its arrival
+// time and passes it to the audio loop through a lock-free ring. The audio loop takes what
+// has arrived at the start of each block. As with MIDI files, only channel messages are
+// delivered; sysex and system messages are skipped.
+// License https://creativecommons.org/publicdomain/zero/1.0/
+
+#include <stdint.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include "__SIM_INCLUDE.h"
+#include "driver/benchmark.h"
+#include "driver/ring.h"
+
+struct LiveMidiEvent {
+  BenchClock::time_point arrived;
+  MidiMessage msg;
+};
+
+class LiveMidiInput {
+  int fd;
+  int keepOpen;  // Our own write end of a FIFO, so it doesn't hit end of file between writers
+  bool usbPackets;
+  SpscRing<LiveMidiEvent> ring;
+  std::thread thread;
+  std::atomic<bool> stopping;
+  std::atomic<uint64_t> dropped; // Ring was full
+  std::atomic<uint64_t> skipped; // Bytes or packets that weren't channel messages
+  std::string error;
+
+  // Raw byte parser state
+  uint8_t status, pending[2];
+  int pendingCount;
+
+  bool fail(const std::string &why) {
+    error = why;
+    return false;
+  }
+
+  void run();
+  void parse(const uint8_t *bytes, size_t count, BenchClock::time_point now);
+  void deliver(MidiMessage msg, BenchClock::time_point now);
+
+public:
+  LiveMidiInput(size_t ringEvents = 4096) : fd(-1), keepOpen(-1), usbPackets(false), ring(ringEvents),
+    stopping(false), dropped(0), skipped(0), status(0), pendingCount(0) {}
+  ~LiveMidiInput() { close(); }
+
+  const std::string &getError() { return error; }
+
+  // A socket path is connected to; anything else is opened for reading
+  bool open(const char *path, bool _usbPackets);
+
+  // Append everything that has arrived so far
+  void poll(std::vector<LiveMidiEvent> &out);
+
+  uint64_t getDropped() { return dropped.load(); }
+  uint64_t getSkipped() { return skipped.load(); }
+
+  void close();
+};
+
+#endif // __driver_midiIn_hpp__
@@ -0,0 +1,38 @@
+// Outbound MIDI log for MagusSim.
+// License https://creativecommons.org/publicdomain/zero/1.0/
+
+#include "driver/midiOut.h"
+
+void MidiOutLog::report(FILE *out, float sampleRate, int blockSize, int samples) const {
+  size_t constructed = startup;
+  size_t peak = 0, run = 0;
+  int peakBlock = -1, block = -1;
+  uint64_t wireBytes = 0;
+  size_t skipped = 0, skippedLater = 0;
+  for(size_t c = 0; c < events.size(); c++) {
+    wireBytes += midiWireLength(events[c].msg.data[1]);
+    if (!midiIsChannelStatus(events[c].msg.data[1])) {
+      skipped++;
+      if (c >= constructed) skippedLater++;
+    }
+    if (c < constructed) continue;
+    int b = events[c].at / blockSize;
+    run = b == block ? run + 1 : 1;
+    block = b;
+    if (run > peak) {
+      peak = run;
+      peakBlock = b;
+    }
+  }
+  size_t blocks = samples > 0 ? (samples + blockSize - 1) / blockSize : 0;
+  double seconds = samples / sampleRate;
+  size_t later = events.size() - constructed;
+  fprintf(out, "  sendMidi: %zu messages (%zu at startup), %llu wire bytes, %zu USB-MIDI bytes\n",
+    events.size(), constructed, (unsigned long long)wireBytes, (events.size() - skipped)*USB_MIDI_PACKET_BYTES);
+  if (skipped)
+    fprintf(out, "  sendMidi: skipped %zu non-channel messages (status outside 0x80-0xEF) in the bytes above and --midi-out\n", skipped);
+  fprintf(out, "  sendMidi after startup: %.3f messages/block, peak %zu in one block", blocks ? (double)later/blocks : 0.0, peak);
+  if (peakBlock >= 0)
+    fprintf(out, " (block at sample %d)", peakBlock*blockSize);
+  fprintf(out, ", %.1f USB-MIDI bytes/sec\n", seconds > 0 ? (later - skippedLater)*USB_MIDI_PACKET_BYTES/seconds : 0.0);
+}
@@ -0,0 +1,34 @@
+#ifndef __driver_midiOut_hpp__
+#define __driver_midiOut_hpp__
+
+// Log of everything a patch passes to sendMidi, for MagusSim. Messages are stamped with
+// the sample position of the callback that sent them; the constructor counts as sample 0.
+// License https://creativecommons.org/publicdomain/zero/1.0/
+
+#include <stdio.h>
+#include <vector>
+#include "driver/midiFile.h"
+
+#define USB_MIDI_PACKET_BYTES 4
+
+class MidiOutLog {
+  std::vector<SimEvent> events;
+  size_t startup; // How many messages the constructor sent
+
+public:
+  int now; // Sample position the driver is currently running
+
+  MidiOutLog() : startup(0), now(0) { events.reserve(4096); }
+
+  void record(MidiMessage msg) { events.push_back(SimEvent(now, msg)); }
+  void endStartup() { startup = events.size(); }
+  size_t size() const { return events.size(); }
+
+  bool write(const char *path, float sampleRate) const { return writeMidiFile(path, events, sampleRate); }
+
+  // Traffic summary. The constructor's burst is reported on its own since it happens
+  // before audio starts.
+  void report(FILE *out, float sampleRate, int blockSize, int samples) const;
+};
+
+#endif // __driver_midiOut_hpp__
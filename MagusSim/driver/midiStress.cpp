@@ -0,0 +1,165 @@
+// MIDI storms for MagusSim.
+// License https://creativecommons.org/publicdomain/zero/1.0/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <random>
+#include "driver/benchmark.h"
+#include "driver/midiStress.h"
+
+// The CCs in NanoKontrolSeq's ccDb
+static const uint8_t nanoKontrolCcs[] = {2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 14, 15, 16, 17, 18, 19,
+  25, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40, 41, 42, 43, 44, 45, 46,
+  47, 48, 49, 50, 51, 52, 53, 54, 55, 56, 57, 58, 59};
+
+thread_local SimMidiCheck *simMidiCheck = NULL;
+
+bool MidiStress::add(const char *spec) {
+  std::string name = spec;
+  Storm storm;
+  storm.rate = 2000;
+  size_t colon = name.find(':');
+  if (colon != std::string::npos) {
+    char *end;
+    storm.rate = strtod(name.c_str() + colon + 1, &end);
+    if (*end || !(storm.rate > 0))
+      return fail("bad rate in " + name);
+    name.resize(colon);
+  }
+  if (name == "notes")
+    storm.kind = STORM_NOTES;
+  else if (name == "overflow")
+    storm.kind = STORM_OVERFLOW;
+  else if (name == "duplicates")
+    storm.kind = STORM_DUPLICATES;
+  else if (name == "cc")
+    storm.kind = STORM_CC;
+  else if (name == "ccall")
+    storm.kind = STORM_CC_ALL;
+  else
+    return fail("unknown storm " + name + " (notes, overflow, duplicates, cc or ccall)");
+  storms.push_back(storm);
+  return true;
+}
+
+// Unlike MidiMessage::note, keeps velocity 0 as a note-on
+static MidiMessage noteOn(uint8_t note, uint8_t velocity) {
+  return MidiMessage(USB_COMMAND_NOTE_ON, NOTE_ON, note & 0x7F, velocity & 0x7F);
+}
+
+static MidiMessage noteOff(uint8_t note) {
+  return MidiMessage::note(0, note, 0);
+}
+
+void MidiStress::generate(int samples, float sampleRate, std::vector<SimEvent> &events) const {
+  std::mt19937 rng(seed); // Fixed algorithm, so a seed means the same storm everywhere
+  for(size_t s = 0; s < storms.size(); s++) {
+    const Storm &storm = storms[s];
+    std::vector<uint8_t> held;
+    double t = 0;
+    while (true) {
+      t += -log(1 - rng() / 4294967296.0) / storm.rate;
+      int at = (int)(t * sampleRate);
+      if (at >= samples)
+        break;
+      switch (storm.kind) {
+        case STORM_NOTES: {
+          bool on = held.empty() || rng() % 2;
+          if (on) {
+            uint8_t note = rng() % 128;
+            uint8_t velocity = rng() % 16 ? 1 + rng() % 127 : 0; // Sometimes a note-on that means off
+            events.push_back(SimEvent(at, noteOn(note, velocity)));
+            if (velocity) held.push_back(note);
+          } else if (rng() % 4) { // Usually a held note, sometimes a stray one
+            size_t which = rng() % held.size();
+            events.push_back(SimEvent(at, noteOff(held[which])));
+            held.erase(held.begin() + which);
+          } else {
+            events.push_back(SimEvent(at, noteOff(rng() % 128)));
+          }
+        } break;
+        case STORM_OVERFLOW: {
+          if (held.size() < 40) {
+            uint8_t note = 24 + held.size()*2 + rng() % 2;
+            events.push_back(SimEvent(at, noteOn(note, 100)));
+            held.push_back(note);
+          } else {
+            while (!held.empty()) { // Let go of everything at once, in any order
+              size_t which = rng() % held.size();
+              events.push_back(SimEvent(at, noteOff(held[which])));
+              held.erase(held.begin() + which);
+            }
+          }
+        } break;
+        case STORM_DUPLICATES: {
+          uint8_t note = 60 + rng() % 4;
+          if (rng() % 8)
+            events.push_back(SimEvent(at, noteOn(note, 1 + rng() % 127)));
+          else
+            events.push_back(SimEvent(at, noteOff(note)));
+        } break;
+        case STORM_CC:
+        case STORM_CC_ALL: {
+          uint8_t cc = storm.kind == STORM_CC ? nanoKontrolCcs[rng() % sizeof(nanoKontrolCcs)] : rng() % 128;
+          uint8_t value = rng() % 4 ? (rng() % 2 ? 127 : 0) : rng() % 128;
+          events.push_back(SimEvent(at, MidiMessage::cc(rng() % 16 ? 0 : rng() % 16, cc, value)));
+        } break;
+      }
+    }
+  }
+}
+
+static int64_t steadyNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(BenchClock::now().time_since_epoch()).count();
+}
+
+void SimMidiCheck::startWatchdog(int limitMs) {
+  watchdog = std::thread([this, limitMs]() {
+    while (!stopping.load()) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      int64_t started = callStarted.load();
+      if (started && steadyNs() - started > limitMs * 1000000LL) {
+        MidiMessage msg(callMessage.load());
+        fprintf(stderr, "Error: processMidi has run for over %d ms on %02x %02x %02x, near sample %d. "
+          "The patch looks stuck.\n", limitMs, msg.data[1], msg.data[2], msg.data[3], now.load());
+        _exit(3); // The audio thread can't be stopped, so don't wait for it
+      }
+    }
+  });
+}
+
+void SimMidiCheck::stopWatchdog() {
+  stopping.store(true);
+  if (watchdog.joinable())
+    watchdog.join();
+}
+
+void SimMidiCheck::check(Patch &patch, MidiMessage msg) {
+  const char *problem = patch._simCheckInvariants();
+  if (!problem)
+    return;
+  violations++;
+  if (firstViolations.size() < VIOLATIONS_LISTED) {
+    char line[160];
+    snprintf(line, sizeof(line), "sample %d, after %02x %02x %02x: %s", now.load(),
+      msg.data[1], msg.data[2], msg.data[3], problem);
+    firstViolations.push_back(line);
+  }
+}
+
+void SimMidiCheck::report(FILE *out) const {
+  static const char *names[8] = {"note off", "note on", "poly pressure", "control change",
+    "program change", "channel pressure", "pitch bend", "system"};
+  fprintf(out, "Per message processMidi time:\n");
+  for(int c = 0; c < 8; c++) {
+    if (byStatus[c].count())
+      byStatus[c].report(out, names[c], 0, true);
+  }
+  fprintf(out, "Invariant violations: %llu\n", (unsigned long long)violations);
+  for(size_t c = 0; c < firstViolations.size(); c++)
+    fprintf(out, "  %s\n", firstViolations[c].c_str());
+  if (violations > firstViolations.size())
+    fprintf(out, "  ...\n");
+}
@@ -0,0 +1,83 @@
+#ifndef __driver_midiStress_hpp__
+#define __driver_midiStress_hpp__
+
+// MIDI storms for finding the worst case of processMidi. Each --stress adds one storm:
+//   notes       random note on/off over the whole keyboard
+//   overflow    note-ons with no note-offs, past the 31-note stack, then all released
+//   duplicates  note-ons repeated on a few notes without their note-offs
+//   cc          controller changes on the CCs in NanoKontrolSeq's ccDb, mostly 0 or 127
+//   ccall       the same on every CC number
+// with an optional rate in events per second, eg "notes:5000". Arrivals are random
+// (Poisson), so dense bursts with several events on one sample happen too.
+// While a SimMidiCheck is installed every processMidi call is timed by message type and
+// followed by the patch's _simCheckInvariants(), and a watchdog ends the run if one call
+// takes so long the patch must be stuck.
+// License https://creativecommons.org/publicdomain/zero/1.0/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include "__SIM_INCLUDE.h"
+#include "driver/midiFile.h"
+#include "driver/histogram.h"
+
+class MidiStress {
+  enum Kind { STORM_NOTES, STORM_OVERFLOW, STORM_DUPLICATES, STORM_CC, STORM_CC_ALL };
+  struct Storm {
+    Kind kind;
+    double rate;
+  };
+  std::vector<Storm> storms;
+  unsigned seed;
+  std::string error;
+
+  bool fail(const std::string &why) {
+    error = why;
+    return false;
+  }
+
+public:
+  MidiStress() : seed(1) {}
+
+  const std::string &getError() { return error; }
+  bool empty() { return storms.empty(); }
+
+  bool add(const char *spec);
+  void setSeed(unsigned _seed) { seed = _seed; }
+
+  // Append every storm's events for a run of this many samples. Sort afterward.
+  void generate(int samples, float sampleRate, std::vector<SimEvent> &events) const;
+};
+
+struct SimMidiCheck {
+  LatencyHistogram byStatus[8]; // Indexed by the status nibble, 0x8..0xF
+  uint64_t violations;
+  std::vector<std::string> firstViolations;
+  std::atomic<int> now; // Sample offset, for reporting
+
+  // The call in progress, for the watchdog: start time in steady clock ns, 0 between calls
+  std::atomic<int64_t> callStarted;
+  std::atomic<uint32_t> callMessage;
+  std::thread watchdog;
+  std::atomic<bool> stopping;
+
+  static const size_t VIOLATIONS_LISTED = 10;
+
+  SimMidiCheck() : violations(0), now(0), callStarted(0), callMessage(0), stopping(false) {}
+  ~SimMidiCheck() { stopWatchdog(); }
+
+  // If a single processMidi call runs longer than this, report it and exit
+  void startWatchdog(int limitMs);
+  void stopWatchdog();
+
+  void check(Patch &patch, MidiMessage msg);
+  void report(FILE *out) const;
+};
+
+// When set, simProcessMidi times and checks each message with this
+extern thread_local SimMidiCheck *simMidiCheck;
+
+#endif // __driver_midiStress_hpp__
@@ -0,0 +1,166 @@
+// Hardware performance counters for MagusSim.
+// License https://creativecommons.org/publicdomain/zero/1.0/
+
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "driver/perfCounters.h"
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+thread_local PerfCounters *simPerfCounters = NULL;
+
+static const char *counterNames[SIM_COUNTER_COUNT] = {"cycles", "instructions", "L1D read misses", "branch misses"};
+
+SimCounterTotals::SimCounterTotals() : calls(0), samples(0), worstCycles(0) {
+  memset(value, 0, sizeof(value));
+}
+
+PerfCounters::PerfCounters() : leader(-1), opened(0) {
+  for(int c = 0; c < SIM_COUNTER_COUNT; c++) {
+    fds[c] = -1;
+    slot[c] = -1;
+  }
+}
+
+PerfCounters::~PerfCounters() {
+  close();
+}
+
+#ifdef __linux__
+
+// Group reads come back as {nr, time_enabled, time_running, value[nr]}
+#define GROUP_HEADER 3
+
+static std::string openError(int err) {
+  switch (err) {
+    case ENOENT: case EOPNOTSUPP:
+      return "not supported by this CPU, or not passed through to this VM or container";
+    case EACCES: case EPERM:
+      return "not permitted; lower /proc/sys/kernel/perf_event_paranoid to 2 or below";
+    case ENOSYS:
+      return "this kernel has no perf events";
+    default:
+      return strerror(err);
+  }
+}
+
+bool PerfCounters::open() {
+  static const uint32_t types[SIM_COUNTER_COUNT] = {PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE,
+    PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE};
+  static const uint64_t configs[SIM_COUNTER_COUNT] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+    PERF_COUNT_HW_BRANCH_MISSES};
+  close();
+  for(int c = 0; c < SIM_COUNTER_COUNT; c++) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = types[c];
+    attr.config = configs[c];
+    attr.exclude_kernel = 1; // The patch never enters the kernel, and paranoid 2 only allows user space
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    // One group, so a single read gets every counter and they are all scheduled together
+    int fd = syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0);
+    if (fd < 0) {
+      why[c] = openError(errno);
+      continue;
+    }
+    fds[c] = fd;
+    if (leader < 0) leader = fd;
+    slot[c] = opened++;
+  }
+  return opened > 0;
+}
+
+void PerfCounters::close() {
+  for(int c = SIM_COUNTER_COUNT; c-- > 0;) { // Group members before the leader
+    if (fds[c] >= 0) ::close(fds[c]);
+    fds[c] = -1;
+    slot[c] = -1;
+  }
+  leader = -1;
+  opened = 0;
+}
+
+void PerfCounters::read(SimCounterSample &sample) {
+  uint64_t group[GROUP_HEADER + SIM_COUNTER_COUNT];
+  if (leader < 0 || ::read(leader, group, sizeof(group)) < (ssize_t)((GROUP_HEADER + opened)*sizeof(uint64_t))) {
+    memset(&sample, 0, sizeof(sample));
+    return;
+  }
+  for(int c = 0; c < SIM_COUNTER_COUNT; c++)
+    sample.value[c] = slot[c] < 0 ? 0 : group[GROUP_HEADER + slot[c]];
+}
+
+// How much of the time the group was actually on the PMU. Below 1 when it was multiplexed
+// with other users' counters, and then calls made while it was off count as nothing.
+static double runningFraction(int leader, int opened) {
+  uint64_t group[GROUP_HEADER + SIM_COUNTER_COUNT];
+  if (leader < 0 || ::read(leader, group, sizeof(group)) < (ssize_t)((GROUP_HEADER + opened)*sizeof(uint64_t)) || !group[1])
+    return 1;
+  return (double)group[2]/group[1];
+}
+
+#else
+
+bool PerfCounters::open() {
+  for(int c = 0; c < SIM_COUNTER_COUNT; c++)
+    why[c] = "perf_event_open is only on Linux";
+  return false;
+}
+
+void PerfCounters::close() {}
+
+void PerfCounters::read(SimCounterSample &sample) {
+  memset(&sample, 0, sizeof(sample));
+}
+
+static double runningFraction(int leader, int opened) {
+  return 1;
+}
+
+#endif
+
+static void reportCallback(FILE *out, const char *name, const SimCounterTotals &t, const int *slot) {
+  if (!t.calls)
+    return;
+  fprintf(out, "  %s: %llu calls", name, (unsigned long long)t.calls);
+  if (t.samples)
+    fprintf(out, ", %llu samples", (unsigned long long)t.samples);
+  fprintf(out, "\n");
+  uint64_t instructions = t.value[SIM_INSTRUCTIONS];
+  for(int c = 0; c < SIM_COUNTER_COUNT; c++) {
+    if (slot[c] < 0)
+      continue;
+    fprintf(out, "    %-16s %14llu total %12.1f/call", counterNames[c], (unsigned long long)t.value[c], (double)t.value[c]/t.calls);
+    if (t.samples)
+      fprintf(out, " %10.2f/sample", (double)t.value[c]/t.samples);
+    if (c == SIM_CYCLES)
+      fprintf(out, "  worst call %llu", (unsigned long long)t.worstCycles);
+    else if (c == SIM_INSTRUCTIONS && slot[SIM_CYCLES] >= 0 && t.value[SIM_CYCLES])
+      fprintf(out, "  %.2f per cycle", (double)instructions/t.value[SIM_CYCLES]);
+    else if (c != SIM_INSTRUCTIONS && slot[SIM_INSTRUCTIONS] >= 0 && instructions)
+      fprintf(out, "  %.2f per 1000 instructions", 1000.0*t.value[c]/instructions);
+    fprintf(out, "\n");
+  }
+}
+
+void PerfCounters::report(FILE *out) {
+  fprintf(out, "Counters (user space, during patch callbacks):\n");
+  for(int c = 0; c < SIM_COUNTER_COUNT; c++)
+    if (slot[c] < 0)
+      fprintf(out, "  %s unavailable: %s\n", counterNames[c], why[c].empty() ? "not opened" : why[c].c_str());
+  if (!opened)
+    return;
+  reportCallback(out, "processAudio", processAudio, slot);
+  reportCallback(out, "processMidi", processMidi, slot);
+  double running = runningFraction(leader, opened);
+  if (running < 0.999)
+    fprintf(out, "  the counters were only on the CPU %.1f%% of the time, as other programs were using it; calls in between counted as 0\n",
+      100*running);
+}
@@ -0,0 +1,70 @@
+#ifndef __driver_perfCounters_hpp__
+#define __driver_perfCounters_hpp__
+
+// Hardware performance counters for MagusSim's --counters: cycles, instructions, L1 data
+// cache read misses and branch mispredictions, read through Linux perf_event_open just
+// before and after each processAudio and processMidi call, so only the patch's own work
+// (in user space, on this thread) is counted. Counters the kernel won't give, because of
+// perf_event_paranoid, a VM or container without a PMU, or another OS, are reported as
+// unavailable and the run carries on without them.
+// License https://creativecommons.org/publicdomain/zero/1.0/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+
+enum SimCounterId { SIM_CYCLES, SIM_INSTRUCTIONS, SIM_L1D_MISSES, SIM_BRANCH_MISSES, SIM_COUNTER_COUNT };
+
+struct SimCounterSample {
+  uint64_t value[SIM_COUNTER_COUNT];
+};
+
+// Everything counted in one kind of callback
+struct SimCounterTotals {
+  uint64_t calls, samples;
+  uint64_t value[SIM_COUNTER_COUNT];
+  uint64_t worstCycles; // Most in a single call
+
+  SimCounterTotals();
+};
+
+class PerfCounters {
+  int fds[SIM_COUNTER_COUNT]; // -1 where the counter couldn't be opened
+  int slot[SIM_COUNTER_COUNT]; // Index into the group read, -1 if unavailable
+  int leader, opened;
+  std::string why[SIM_COUNTER_COUNT];
+
+public:
+  SimCounterTotals processAudio, processMidi;
+
+  PerfCounters();
+  ~PerfCounters();
+
+  // Open whatever counters this machine allows. False if there are none.
+  bool open();
+  void close();
+  bool available() { return opened > 0; }
+
+  // Current counts, 0 for unavailable counters
+  void read(SimCounterSample &sample);
+
+  // Add what was counted since "before" as one call that processed this many samples
+  void add(SimCounterTotals &totals, const SimCounterSample &before, int samples) {
+    SimCounterSample after;
+    read(after);
+    totals.calls++;
+    totals.samples += samples;
+    for(int c = 0; c < SIM_COUNTER_COUNT; c++)
+      totals.value[c] += after.value[c] - before.value[c];
+    uint64_t cycles = after.value[SIM_CYCLES] - before.value[SIM_CYCLES];
+    if (cycles > totals.worstCycles) totals.worstCycles = cycles;
+  }
+
+  // Totals, per call, per sample and per 1000 instructions for each callback
+  void report(FILE *out);
+};
+
+// When set, simProcessBlock and simProcessMidi count every patch callback into these
+extern thread_local PerfCounters *simPerfCounters;
+
+#endif // __driver_perfCounters_hpp__
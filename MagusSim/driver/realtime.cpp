@@ -0,0 +1,104 @@
+// Real-time pacing for MagusSim.
+// License https://creativecommons.org/publicdomain/zero/1.0/
+
+#include <algorithm>
+#include "driver/realtime.h"
+
+void RealtimePacer::begin(float _sampleRate) {
+  sampleRate = _sampleRate;
+  start = BenchClock::now();
+}
+
+void RealtimePacer::wait(int off) {
+  release = due(off);
+  std::this_thread::sleep_until(release);
+}
+
+void RealtimePacer::done(int off, int count) {
+  BenchClock::time_point now = BenchClock::now();
+  BenchClock::time_point deadline = due(off + count);
+  double period = count * 1e9 / sampleRate;
+  double load = std::max<int64_t>(benchNs(release, now), 0) / period;
+  blocks++;
+  loadTotal += load;
+  loadPeak = std::max(loadPeak, load);
+  if (now > deadline) {
+    uint64_t late = benchNs(deadline, now);
+    xruns++;
+    worstLateNs = std::max(worstLateNs, late);
+    if (xrunAt.size() < XRUNS_LISTED)
+      xrunAt.push_back(off);
+    start += now - deadline;
+  }
+}
+
+void RealtimePacer::report(FILE *out) const {
+  fprintf(out, "Real time: %llu blocks, %llu xruns", (unsigned long long)blocks, (unsigned long long)xruns);
+  if (xruns)
+    fprintf(out, ", worst %.3f ms late", worstLateNs / 1e6);
+  if (blocks)
+    fprintf(out, "; load mean %.1f%%, peak %.1f%% of the block period", 100*loadTotal/blocks, 100*loadPeak);
+  fprintf(out, "\n");
+  if (xruns) {
+    fprintf(out, "  xruns in blocks at sample");
+    for(size_t c = 0; c < xrunAt.size(); c++)
+      fprintf(out, " %d", xrunAt[c]);
+    if (xruns > xrunAt.size())
+      fprintf(out, " ...");
+    fprintf(out, "\n");
+  }
+}
+
+void RealtimeOutput::run() {
+  std::vector<StereoFrame> chunk(CHUNK);
+  std::vector<float> left(CHUNK), right(CHUNK);
+  while (true) {
+    bool done = stopping.load(); // Check before popping so the last frames aren't missed
+    size_t got = ring.pop(&chunk[0], CHUNK);
+    if (got == 0) {
+      if (done) break;
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      continue;
+    }
+    for(size_t c = 0; c < got; c++) {
+      left[c] = chunk[c].left;
+      right[c] = chunk[c].right;
+    }
+    writer.write(&left[0], &right[0], got);
+    writer.flush(); // Whatever reads the output is listening in real time too
+  }
+}
+
+void RealtimeOutput::start() {
+  thread = std::thread(&RealtimeOutput::run, this);
+}
+
+void RealtimeOutput::write(const float *left, const float *right, size_t count) {
+  scratch.resize(count);
+  for(size_t c = 0; c < count; c++) {
+    scratch[c].left = left[c];
+    scratch[c].right = right[c];
+  }
+  size_t pushed = ring.push(&scratch[0], count);
+  if (pushed < count) {
+    stalls++;
+    while (pushed < count) {
+      std::this_thread::yield();
+      pushed += ring.push(&scratch[pushed], count - pushed);
+    }
+  }
+  peakFill = std::max(peakFill, ring.available());
+}
+
+void RealtimeOutput::close() {
+  stopping.store(true);
+  if (thread.joinable())
+    thread.join();
+}
+
+void RealtimeOutput::report(FILE *out) const {
+  fprintf(out, "  output ring: peak %zu of %zu frames", peakFill, ring.capacity());
+  if (stalls)
+    fprintf(out, ", %llu blocks waited for the writer", (unsigned long long)stalls);
+  fprintf(out, "\n");
+}
@@ -0,0 +1,80 @@
+#ifndef __driver_realtime_hpp__
+#define __driver_realtime_hpp__
+
+// Real-time pacing for the MagusSim --realtime mode. RealtimePacer holds each block back
+// until the moment the device would ask for it and counts an xrun when the patch finishes
+// after the block's deadline. RealtimeOutput hands finished audio to a writer thread
+// through a lock-free ring, so a slow disk or pipe doesn't count against the patch.
+// License https://creativecommons.org/publicdomain/zero/1.0/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "driver/benchmark.h"
+#include "driver/ring.h"
+#include "driver/wavFile.h"
+
+class RealtimePacer {
+  double sampleRate;
+  BenchClock::time_point start;  // When sample 0 was due; moved on by each xrun
+  BenchClock::time_point release; // When the current block was due
+  uint64_t blocks, xruns;
+  uint64_t worstLateNs;
+  double loadTotal, loadPeak;     // Fraction of the block period spent processing
+  std::vector<int> xrunAt;        // Sample offsets of the first few xruns
+
+  static const size_t XRUNS_LISTED = 16;
+
+  BenchClock::time_point due(int64_t sample) {
+    return start + std::chrono::nanoseconds((int64_t)(sample * 1e9 / sampleRate));
+  }
+
+public:
+  RealtimePacer() : sampleRate(48000), blocks(0), xruns(0), worstLateNs(0), loadTotal(0), loadPeak(0) {}
+
+  void begin(float _sampleRate);
+
+  // Sleep until the block starting at sample "off" is due
+  void wait(int off);
+
+  // The block [off, off+count) is finished. If it missed its deadline this counts an
+  // xrun, and the schedule slips by the same amount, as the device would drop the block
+  // and carry on rather than try to catch up.
+  void done(int off, int count);
+
+  uint64_t getXruns() const { return xruns; }
+  void report(FILE *out) const;
+};
+
+class RealtimeOutput {
+  AudioWriter &writer;
+  SpscRing<StereoFrame> ring;
+  std::thread thread;
+  std::atomic<bool> stopping;
+  std::vector<StereoFrame> scratch;
+  uint64_t stalls;  // Blocks that waited for room in the ring
+  size_t peakFill;
+
+  static const size_t CHUNK = 4096;
+
+  void run();
+
+public:
+  RealtimeOutput(AudioWriter &_writer, size_t ringFrames = 1 << 16)
+    : writer(_writer), ring(ringFrames), stopping(false), stalls(0), peakFill(0) {}
+  ~RealtimeOutput() { close(); }
+
+  void start();
+
+  // Queue one block for the writer thread. Only waits if the ring is full.
+  void write(const float *left, const float *right, size_t count);
+
+  // Let the writer thread empty the ring, then stop it
+  void close();
+
+  void report(FILE *out) const;
+};
+
+#endif // __driver_realtime_hpp__
@@ -0,0 +1,52 @@
+// Patch registry for MagusSim.
+// License https://creativecommons.org/publicdomain/zero/1.0/
+
+#include <strings.h>
+#include <string.h>
+#include <algorithm>
+#include "driver/registry.h"
+#include "driver/heap.h"
+
+// Function-local so it exists before any patch's registration runs, whatever the link order
+static std::vector<SimPatchEntry> &registry() {
+  static std::vector<SimPatchEntry> entries;
+  return entries;
+}
+
+static bool entryEarlier(const SimPatchEntry &a, const SimPatchEntry &b) {
+  return strcmp(a.name, b.name) < 0;
+}
+
+const std::vector<SimPatchEntry> &SimPatchRegistry::entries() {
+  return registry();
+}
+
+void SimPatchRegistry::add(const SimPatchEntry &entry) {
+  std::vector<SimPatchEntry> &entries = registry();
+  entries.insert(std::upper_bound(entries.begin(), entries.end(), entry, entryEarlier), entry);
+}
+
+const SimPatchEntry *SimPatchRegistry::find(const char *name) {
+  const std::vector<SimPatchEntry> &entries = registry();
+  size_t len = strlen(name);
+  for(size_t c = 0; c < entries.size(); c++) {
+    const char *candidate = entries[c].name;
+    if (!strcasecmp(candidate, name))
+      return &entries[c];
+    size_t candidateLen = strlen(candidate);
+    if (candidateLen == len + 5 && !strncasecmp(candidate, name, len) && !strcmp(candidate + len, "Patch"))
+      return &entries[c];
+  }
+  return NULL;
+}
+
+Patch *SimPatchEntry::create() const {
+  void *storage = simPatchStorageAlloc(size, align);
+  if (!storage)
+    return NULL;
+  return construct(storage);
+}
+
+void SimPatchEntry::destroy(Patch *patch) const {
+  simPatchStorageFree(destruct(patch));
+}
@@ -0,0 +1,49 @@
+#ifndef __driver_registry_hpp__
+#define __driver_registry_hpp__
+
+// Patch registry for MagusSim. Each patch is compiled in its own translation unit,
+// which registers a factory here at static initialization time; the driver then
+// picks one by name at runtime, so a single simulator can carry any number of patches.
+// License https://creativecommons.org/publicdomain/zero/1.0/
+
+#include <stddef.h>
+#include <new>
+#include <vector>
+#include "__SIM_INCLUDE.h"
+
+struct SimPatchEntry {
+  const char *name; // Class name, eg "Saw4Patch"
+  const char *file; // Source file it came from
+  size_t size;      // sizeof the patch class
+  size_t align;     // alignof the patch class
+  Patch *(*construct)(void *storage);
+  void *(*destruct)(Patch *patch); // Returns the storage
+
+  // Construct in storage of its own, aligned to at least a cache line. Undo with destroy().
+  Patch *create() const;
+  void destroy(Patch *patch) const;
+};
+
+class SimPatchRegistry {
+public:
+  // All registered patches, sorted by name
+  static const std::vector<SimPatchEntry> &entries();
+
+  // Accepts the class name or the class name without its "Patch" suffix, ignoring case.
+  // NULL if there is no such patch.
+  static const SimPatchEntry *find(const char *name);
+
+  static void add(const SimPatchEntry &entry);
+};
+
+struct SimPatchRegistration {
+  SimPatchRegistration(const SimPatchEntry &entry) { SimPatchRegistry::add(entry); }
+};
+
+#define SIM_REGISTER_PATCH(cls, file) \
+  static Patch *_simConstruct_##cls(void *storage) { return new(storage) cls(); } \
+  static void *_simDestruct_##cls(Patch *patch) { cls *p = static_cast<cls *>(patch); p->~cls(); return p; } \
+  static SimPatchEntry _simEntry_##cls = {#cls, file, sizeof(cls), alignof(cls), _simConstruct_##cls, _simDestruct_##cls}; \
+  static SimPatchRegistration _simRegister_##cls(_simEntry_##cls);
+
+#endif // __driver_registry_hpp__
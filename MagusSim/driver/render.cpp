@@ -0,0 +1,87 @@
+// Block processing for MagusSim.
+// License https://creativecommons.org/publicdomain/zero/1.0/
+
+#include "driver/render.h"
+#include "driver/benchmark.h"
+#include "driver/heap.h"
+#include "driver/midiStress.h"
+#include "driver/perfCounters.h"
+
+thread_local MidiOutLog *simMidiOutLog = NULL;
+thread_local SimCallbackTimes *simCallbackTimes = NULL;
+
+void simProcessMidi(Patch &patch, MidiMessage msg) {
+  SimCallbackTimes *times = simCallbackTimes;
+  BenchClock::time_point start;
+  SimMidiCheck *check = simMidiCheck;
+  if (times || check) start = BenchClock::now();
+  if (check) {
+    check->callMessage.store(msg.packed);
+    check->callStarted.store(std::chrono::duration_cast<std::chrono::nanoseconds>(start.time_since_epoch()).count());
+  }
+  {
+    SimHeapScope heap;
+    PerfCounters *counters = simPerfCounters;
+    SimCounterSample before;
+    if (counters) counters->read(before);
+    patch.processMidi(msg);
+    if (counters) counters->add(counters->processMidi, before, 0);
+  }
+  if (times || check) {
+    uint64_t ns = benchNs(start, BenchClock::now());
+    if (times) times->processMidi.record(ns);
+    if (check) {
+      check->callStarted.store(0);
+      check->byStatus[(msg.data[1] >> 4) & 7].record(ns);
+      check->check(patch, msg);
+    }
+  }
+}
+
+void simProcessBlock(Patch &patch, AudioBuffer &buffer, int off, int count, int blockSize,
+    SimEventCursor &midi, Automation *automation) {
+  const std::vector<SimEvent> &events = midi.events;
+  SimCallbackTimes *times = simCallbackTimes;
+  BenchClock::time_point start;
+  int end = off + count;
+  for(int at = off; at < end;) {
+    if (simMidiOutLog)
+      simMidiOutLog->now = at;
+    if (simMidiCheck)
+      simMidiCheck->now = at;
+    while (midi.next < events.size() && events[midi.next].at <= at) {
+      simProcessMidi(patch, events[midi.next].msg);
+      midi.next++;
+    }
+    int subEnd = end;
+    if (midi.next < events.size() && events[midi.next].at < subEnd)
+      subEnd = events[midi.next].at;
+    if (automation) {
+      automation->apply(patch, at);
+      int buttonAt;
+      PatchButtonId button;
+      uint16_t value;
+      while (automation->nextButton(subEnd, buttonAt, button, value)) {
+        if (times) start = BenchClock::now();
+        SimHeapScope heap;
+        patch.buttonChanged(button, value, buttonAt > at ? buttonAt - at : 0);
+        if (times) times->buttonChanged.record(benchNs(start, BenchClock::now()));
+      }
+    }
+    buffer._window(at-off, subEnd-at);
+    _simBlockSize = subEnd-at;
+    if (times) start = BenchClock::now();
+    {
+      SimHeapScope heap;
+      PerfCounters *counters = simPerfCounters;
+      SimCounterSample before;
+      if (counters) counters->read(before);
+      patch.processAudio(buffer);
+      if (counters) counters->add(counters->processAudio, before, subEnd-at);
+    }
+    if (times) times->processAudio.record(benchNs(start, BenchClock::now()));
+    at = subEnd;
+  }
+  buffer._window(0, count);
+  _simBlockSize = blockSize;
+}
@@ -0,0 +1,44 @@
+#ifndef __driver_render_hpp__
+#define __driver_render_hpp__
+
+// The inner loop of MagusSim: runs one block of a patch, delivering MIDI and automation
+// at the exact sample they are due. Shared by the normal driver and sweep workers.
+// License https://creativecommons.org/publicdomain/zero/1.0/
+
+#include <vector>
+#include "__SIM_INCLUDE.h"
+#include "driver/midiFile.h"
+#include "driver/automation.h"
+#include "driver/midiOut.h"
+#include "driver/histogram.h"
+
+// Where the patch's sendMidi goes on this thread; NULL discards it
+extern thread_local MidiOutLog *simMidiOutLog;
+
+// Time taken by each call into the patch, kept for --bench
+struct SimCallbackTimes {
+  LatencyHistogram processAudio, processMidi, buttonChanged, processScreen;
+};
+
+// When set, simProcessBlock times every callback it makes into these
+extern thread_local SimCallbackTimes *simCallbackTimes;
+
+// Queue of timestamped MIDI for one run, and how far it has been played
+struct SimEventCursor {
+  const std::vector<SimEvent> &events;
+  size_t next;
+  SimEventCursor(const std::vector<SimEvent> &_events) : events(_events), next(0) {}
+};
+
+// Deliver one message, timed into simCallbackTimes and with its allocations counted
+void simProcessMidi(Patch &patch, MidiMessage msg);
+
+// Process samples [off, off+count) with the buffer already holding the input. The block is
+// split at each MIDI event so every message lands before the sample it is timestamped at.
+// Button changes from the automation are delivered at the start of the piece they fall in,
+// with their offset into it, as the device does.
+// Leaves the buffer windowed to the whole block and _simBlockSize at blockSize.
+void simProcessBlock(Patch &patch, AudioBuffer &buffer, int off, int count, int blockSize,
+  SimEventCursor &midi, Automation *automation);
+
+#endif // __driver_render_hpp__
@@ -0,0 +1,56 @@
+#ifndef __driver_ring_hpp__
+#define __driver_ring_hpp__
+
+// Bounded lock-free ring for exactly one producer thread and one consumer thread.
+// License https://creativecommons.org/publicdomain/zero/1.0/
+
+#include <stddef.h>
+#include <atomic>
+#include <vector>
+
+template<typename T>
+class SpscRing {
+  std::vector<T> items;
+  size_t mask;
+  // Free-running counters; only the producer writes head and only the consumer writes tail
+  alignas(64) std::atomic<size_t> head;
+  alignas(64) std::atomic<size_t> tail;
+
+public:
+  // Capacity is rounded up to a power of two
+  SpscRing(size_t capacity) : head(0), tail(0) {
+    size_t size = 1;
+    while (size < capacity) size <<= 1;
+    items.resize(size);
+    mask = size - 1;
+  }
+
+  size_t capacity() const { return items.size(); }
+  size_t available() const { return head.load(std::memory_order_acquire) - tail.load(std::memory_order_relaxed); }
+
+  // Producer side. Returns how many items fit.
+  size_t push(const T *from, size_t count) {
+    size_t h = head.load(std::memory_order_relaxed);
+    size_t room = items.size() - (h - tail.load(std::memory_order_acquire));
+    if (count > room) count = room;
+    for(size_t c = 0; c < count; c++)
+      items[(h + c) & mask] = from[c];
+    head.store(h + count, std::memory_order_release);
+    return count;
+  }
+  bool push(const T &item) { return push(&item, 1) == 1; }
+
+  // Consumer side. Returns how many items were taken.
+  size_t pop(T *to, size_t count) {
+    size_t t = tail.load(std::memory_order_relaxed);
+    size_t have = head.load(std::memory_order_acquire) - t;
+    if (count > have) count = have;
+    for(size_t c = 0; c < count; c++)
+      to[c] = items[(t + c) & mask];
+    tail.store(t + count, std::memory_order_release);
+    return count;
+  }
+  bool pop(T &item) { return pop(&item, 1) == 1; }
+};
+
+#endif // __driver_ring_hpp__
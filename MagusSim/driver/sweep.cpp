@@ -0,0 +1,194 @@
+// Parameter sweeps for MagusSim.
+// License https://creativecommons.org/publicdomain/zero/1.0/
+
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <random>
+#include "driver/sweep.h"
+#include "driver/benchmark.h"
+#include "driver/digest.h"
+#include "driver/heap.h"
+#include "driver/render.h"
+#include "driver/threadPool.h"
+
+bool Sweep::addAxis(const char *spec) {
+  const char *equals = strchr(spec, '=');
+  if (!equals)
+    return fail(std::string("expected parameter=values in ") + spec);
+  Axis axis;
+  axis.name = std::string(spec, equals - spec);
+  axis.id = parameterIdFromName(axis.name.c_str());
+  if (axis.id < 0)
+    return fail("unknown parameter " + axis.name);
+  const char *p = equals + 1;
+  char *end;
+  if (strchr(p, ':')) {
+    double low = strtod(p, &end);
+    if (*end != ':') return fail(std::string("bad range in ") + spec);
+    double high = strtod(end + 1, &end);
+    long steps = 2;
+    if (*end == ':')
+      steps = strtol(end + 1, &end, 10);
+    if (*end || steps < 1) return fail(std::string("bad range in ") + spec);
+    for(long c = 0; c < steps; c++)
+      axis.values.push_back(steps == 1 ? low : low + (high - low)*c/(steps - 1));
+  } else {
+    while (1) {
+      double v = strtod(p, &end);
+      if (end == p || (*end && *end != ',')) return fail(std::string("bad value list in ") + spec);
+      axis.values.push_back(v);
+      if (!*end) break;
+      p = end + 1;
+    }
+  }
+  axis.low = axis.high = axis.values[0];
+  for(size_t c = 1; c < axis.values.size(); c++) {
+    if (axis.values[c] < axis.low) axis.low = axis.values[c];
+    if (axis.values[c] > axis.high) axis.high = axis.values[c];
+  }
+  axes.push_back(axis);
+  return true;
+}
+
+std::vector<std::vector<float> > Sweep::points() const {
+  std::vector<std::vector<float> > result;
+  if (axes.empty())
+    return result;
+  if (randomPoints) {
+    std::mt19937 rng(seed); // Fixed algorithm, so a seed means the same points everywhere
+    for(size_t c = 0; c < randomPoints; c++) {
+      std::vector<float> point;
+      for(size_t a = 0; a < axes.size(); a++)
+        point.push_back(axes[a].low + (axes[a].high - axes[a].low)*(rng() / 4294967296.0));
+      result.push_back(point);
+    }
+    return result;
+  }
+  // Count through the grid with the last axis changing fastest
+  std::vector<size_t> at(axes.size(), 0);
+  while (1) {
+    std::vector<float> point;
+    for(size_t a = 0; a < axes.size(); a++)
+      point.push_back(axes[a].values[at[a]]);
+    result.push_back(point);
+    size_t a = axes.size();
+    while (a > 0) {
+      a--;
+      if (++at[a] < axes[a].values.size())
+        break;
+      at[a] = 0;
+      if (a == 0)
+        return result;
+    }
+  }
+}
+
+namespace {
+struct PointResult {
+  AudioDigest digest;
+  uint64_t ns, worstBlockNs;
+  size_t midiOut;
+  std::string error;
+};
+}
+
+static void renderPoint(const Sweep::Render &render, const std::vector<int> &ids, const std::vector<float> &values,
+    size_t index, PointResult &result) {
+  MidiOutLog midiOut;
+  simMidiOutLog = &midiOut;
+  _simBlockSize = render.blockSize;
+  _simProfiling = false; // Other workers run the same patch and would race on its profile sections
+  simHeapEnabled = false; // Sweeps don't report the heap, and tracking would serialize every free
+  Patch *patch = render.patch->create();
+  if (!patch) {
+    result.error = std::string("couldn't allocate ") + render.patch->name;
+    result.ns = result.worstBlockNs = 0;
+    result.midiOut = 0;
+    simMidiOutLog = NULL;
+    return;
+  }
+  for(size_t a = 0; a < ids.size(); a++) {
+    if ((int)patch->_parameters.size() <= ids[a])
+      patch->_parameters.resize(ids[a] + 1);
+    patch->_parameters[ids[a]] = values[a];
+  }
+  Automation automation;
+  if (render.automation)
+    automation = *render.automation; // Has its own play position
+  std::vector<SimEvent> none;
+  SimEventCursor midi(render.events ? *render.events : none);
+  AudioWriter writer;
+  if (render.wavPrefix) {
+    char name[32];
+    snprintf(name, sizeof(name), "%05zu.wav", index);
+    std::string path = std::string(render.wavPrefix) + name;
+    if (!writer.open(path.c_str(), render.wavFormat, _simSampleRate))
+      result.error = "couldn't open " + path;
+  }
+
+  AudioBuffer buffer(render.blockSize);
+  size_t inputFrames = render.input ? render.input->size()/2 : 0;
+  result.ns = result.worstBlockNs = 0;
+  for(int off = 0; off < render.samples; off += render.blockSize) {
+    int count = std::min(render.blockSize, render.samples - off);
+    buffer._window(0, count);
+    buffer._clear();
+    for(size_t c = off; c < inputFrames && c < (size_t)(off + count); c++) {
+      buffer._left._data[c - off] = (*render.input)[2*c];
+      buffer._right._data[c - off] = (*render.input)[2*c+1];
+    }
+    BenchClock::time_point start = BenchClock::now();
+    simProcessBlock(*patch, buffer, off, count, render.blockSize, midi, render.automation ? &automation : NULL);
+    uint64_t ns = benchNs(start, BenchClock::now());
+    result.ns += ns;
+    result.worstBlockNs = std::max(result.worstBlockNs, ns);
+    result.digest.add(buffer._left._data, buffer._right._data, count);
+    if (render.wavPrefix)
+      writer.write(buffer._left._data, buffer._right._data, count);
+  }
+  writer.close();
+  render.patch->destroy(patch);
+  simMidiOutLog = NULL;
+  result.midiOut = midiOut.size();
+}
+
+bool Sweep::run(const Render &render, FILE *results) {
+  std::vector<std::vector<float> > all = points();
+  std::vector<int> ids;
+  for(size_t a = 0; a < axes.size(); a++)
+    ids.push_back(axes[a].id);
+  std::vector<PointResult> done(all.size());
+
+  WorkStealingPool pool(render.threads);
+  BenchClock::time_point start = BenchClock::now();
+  pool.run(all.size(), [&](size_t job, int) {
+    renderPoint(render, ids, all[job], job, done[job]);
+  });
+  uint64_t wallNs = benchNs(start, BenchClock::now());
+
+  fprintf(results, "point");
+  for(size_t a = 0; a < axes.size(); a++)
+    fprintf(results, ",%s", axes[a].name.c_str());
+  fprintf(results, ",hash,peak,rms,nonfinite,ns_per_sample,worst_block_ns,midi_out\n");
+  uint64_t totalNs = 0;
+  bool ok = true;
+  for(size_t c = 0; c < all.size(); c++) {
+    const PointResult &r = done[c];
+    if (!r.error.empty()) {
+      fprintf(stderr, "Error: point %zu: %s\n", c, r.error.c_str());
+      ok = false;
+    }
+    fprintf(results, "%zu", c);
+    for(size_t a = 0; a < axes.size(); a++)
+      fprintf(results, ",%g", all[c][a]);
+    fprintf(results, ",%016llx,%.6f,%.6f,%llu,%.2f,%llu,%zu\n", (unsigned long long)r.digest.getHash(),
+      r.digest.getPeak(), r.digest.getRms(), (unsigned long long)r.digest.getNonFinite(),
+      render.samples > 0 ? (double)r.ns/render.samples : 0.0, (unsigned long long)r.worstBlockNs, r.midiOut);
+    totalNs += r.ns;
+  }
+  fflush(results);
+  fprintf(stderr, "%s: %zu points on %d threads in %.3f s (%.3f s of rendering, %.2fx)\n", render.patch->name,
+    all.size(), pool.size(), wallNs/1e9, totalNs/1e9, wallNs ? (double)totalNs/wallNs : 0.0);
+  return ok;
+}
@@ -0,0 +1,75 @@
+#ifndef __driver_sweep_hpp__
+#define __driver_sweep_hpp__
+
+// Parameter sweeps for MagusSim. Renders one patch at every point of a grid, or at random
+// points inside a range, each point on a fresh patch instance, spread over a work-stealing
+// pool. Writes one CSV line per point: the parameter values, a digest of the output and
+// how long the point took.
+//
+// Each --sweep gives one parameter (named as for automation) and its values:
+//   A=0:1:5        5 evenly spaced values from 0 to 1
+//   A=0,0.3,0.9    exactly these values
+// The grid is every combination. With --sweep-random N, N points are instead drawn
+// uniformly from each parameter's low..high range.
+// License https://creativecommons.org/publicdomain/zero/1.0/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "__SIM_INCLUDE.h"
+#include "driver/registry.h"
+#include "driver/midiFile.h"
+#include "driver/automation.h"
+#include "driver/wavFile.h"
+
+class Sweep {
+  struct Axis {
+    int id;
+    std::string name;
+    std::vector<float> values; // Grid points, low first
+    float low, high;
+  };
+  std::vector<Axis> axes;
+  size_t randomPoints;
+  unsigned seed;
+  std::string error;
+
+  bool fail(const std::string &why) {
+    error = why;
+    return false;
+  }
+
+public:
+  Sweep() : randomPoints(0), seed(1) {}
+
+  const std::string &getError() { return error; }
+  bool empty() const { return axes.empty(); }
+
+  bool addAxis(const char *spec);
+  void setRandom(size_t points, unsigned _seed) { randomPoints = points; seed = _seed; }
+
+  // Every point to render, as one value per axis in the order the axes were added
+  std::vector<std::vector<float> > points() const;
+
+  // How each point is rendered and where the results go
+  struct Render {
+    const SimPatchEntry *patch;
+    int samples;
+    int blockSize;
+    const std::vector<SimEvent> *events;
+    const Automation *automation; // NULL for none; applied on top of the swept values
+    const std::vector<float> *input; // Interleaved stereo, silence after its end; NULL for silence
+    const char *wavPrefix; // Write each point to <prefix><point>.wav; NULL for digests only
+    AudioFormat wavFormat;
+    int threads; // 0 for one per hardware thread
+
+    Render() : patch(NULL), samples(0), blockSize(0), events(NULL), automation(NULL), input(NULL),
+      wavPrefix(NULL), wavFormat(AUDIO_WAV_FLOAT), threads(0) {}
+  };
+
+  // Render every point and write the CSV to results. Prints a summary to stderr.
+  bool run(const Render &render, FILE *results);
+};
+
+#endif // __driver_sweep_hpp__
@@ -0,0 +1,58 @@
+// Work-stealing pool for MagusSim sweeps.
+// License https://creativecommons.org/publicdomain/zero/1.0/
+
+#include <thread>
+#include "driver/threadPool.h"
+
+WorkStealingPool::WorkStealingPool(int workers) {
+  if (workers <= 0)
+    workers = std::thread::hardware_concurrency();
+  if (workers <= 0)
+    workers = 1;
+  std::vector<Queue> made(workers);
+  queues.swap(made);
+}
+
+bool WorkStealingPool::take(int worker, size_t &job) {
+  {
+    Queue &own = queues[worker];
+    std::lock_guard<std::mutex> guard(own.lock);
+    if (!own.jobs.empty()) {
+      job = own.jobs.front();
+      own.jobs.pop_front();
+      return true;
+    }
+  }
+  // Steal from the back, which the owner will reach last
+  for(size_t c = 1; c < queues.size(); c++) {
+    Queue &victim = queues[(worker + c) % queues.size()];
+    std::lock_guard<std::mutex> guard(victim.lock);
+    if (!victim.jobs.empty()) {
+      job = victim.jobs.back();
+      victim.jobs.pop_back();
+      return true;
+    }
+  }
+  return false;
+}
+
+void WorkStealingPool::work(int worker, const std::function<void(size_t job, int worker)> &fn) {
+  size_t job;
+  while (take(worker, job))
+    fn(job, worker);
+}
+
+void WorkStealingPool::run(size_t count, const std::function<void(size_t job, int worker)> &fn) {
+  size_t workers = queues.size();
+  for(size_t w = 0; w < workers; w++) {
+    size_t from = count*w/workers, to = count*(w+1)/workers;
+    for(size_t job = from; job < to; job++)
+      queues[w].jobs.push_back(job);
+  }
+  std::vector<std::thread> threads;
+  for(size_t w = 1; w < workers; w++)
+    threads.push_back(std::thread(&WorkStealingPool::work, this, (int)w, std::cref(fn)));
+  work(0, fn);
+  for(size_t c = 0; c < threads.size(); c++)
+    threads[c].join();
+}
@@ -0,0 +1,35 @@
+#ifndef __driver_threadPool_hpp__
+#define __driver_threadPool_hpp__
+
+// Work-stealing pool for MagusSim sweeps. Jobs are numbered 0..count-1 and dealt out to
+// the workers in contiguous runs; a worker that finishes its own run steals from the far
+// end of another's, so uneven job lengths still keep every core busy.
+// License https://creativecommons.org/publicdomain/zero/1.0/
+
+#include <stddef.h>
+#include <deque>
+#include <mutex>
+#include <vector>
+#include <functional>
+
+class WorkStealingPool {
+  struct Queue {
+    std::mutex lock;
+    std::deque<size_t> jobs;
+  };
+  std::vector<Queue> queues;
+
+  bool take(int worker, size_t &job); // Own queue first, then steal
+  void work(int worker, const std::function<void(size_t job, int worker)> &fn);
+
+public:
+  // Zero means one worker per hardware thread
+  WorkStealingPool(int workers = 0);
+
+  int size() const { return (int)queues.size(); }
+
+  // Run fn on every job number and return when all are done. The calling thread is worker 0.
+  void run(size_t count, const std::function<void(size_t job, int worker)> &fn);
+};
+
+#endif // __driver_threadPool_hpp__
@@ -0,0 +1,166 @@
+// WAV and raw float audio files for MagusSim.
+// License https://creativecommons.org/publicdomain/zero/1.0/
+
+#include "driver/wavFile.h"
+
+void AudioWriter::writeHeader(float sampleRate) {
+  uint8_t h[58], *p = h;
+  bool isFloat = format == AUDIO_WAV_FLOAT;
+  memcpy(p, "RIFF", 4); p = le32(p+4, 0); // Size patched on close
+  memcpy(p, "WAVE", 4); p += 4;
+  memcpy(p, "fmt ", 4); p = le32(p+4, isFloat ? 18 : 16);
+  p = le16(p, isFloat ? 3 : 1);  // WAVE_FORMAT_IEEE_FLOAT or WAVE_FORMAT_PCM
+  p = le16(p, 2);
+  p = le32(p, (uint32_t)sampleRate);
+  p = le32(p, (uint32_t)sampleRate*2*bytesPerSample);
+  p = le16(p, 2*bytesPerSample);
+  p = le16(p, 8*bytesPerSample);
+  factAt = -1;
+  if (isFloat) { // Non-PCM formats carry a cbSize and a fact chunk
+    p = le16(p, 0);
+    memcpy(p, "fact", 4); p = le32(p+4, 4);
+    factAt = p - h;
+    p = le32(p, 0);
+  }
+  memcpy(p, "data", 4); p = le32(p+4, 0);
+  dataAt = (p - h) - 4;
+  fwrite(h, 1, p - h, file);
+}
+
+bool AudioWriter::open(const char *path, AudioFormat _format, float sampleRate) {
+  format = _format;
+  bytesPerSample = format == AUDIO_WAV_16 ? 2 : (format == AUDIO_WAV_24 ? 3 : 4);
+  if (path) {
+    file = fopen(path, "wb");
+    ownFile = true;
+  } else {
+    file = stdout;
+    ownFile = false;
+  }
+  if (!file)
+    return false;
+  buffer.resize(FLUSH_BYTES + 4096*2*sizeof(float));
+  used = 0;
+  frames = 0;
+  if (format != AUDIO_RAW_FLOAT)
+    writeHeader(sampleRate);
+  return true;
+}
+
+void AudioWriter::write(const float *left, const float *right, size_t count) {
+  while (count > 0) {
+    size_t room = (buffer.size() - used) / (2*bytesPerSample);
+    if (room == 0) {
+      flush();
+      continue;
+    }
+    size_t n = count < room ? count : room;
+    uint8_t *p = &buffer[used];
+    switch (format) {
+      case AUDIO_RAW_FLOAT: {
+        float *f = (float *)p;
+        for(size_t c = 0; c < n; c++) {
+          f[2*c] = left[c];
+          f[2*c+1] = right[c];
+        }
+        p += n*2*sizeof(float);
+      } break;
+      case AUDIO_WAV_FLOAT: {
+        uint32_t l, r;
+        for(size_t c = 0; c < n; c++) {
+          memcpy(&l, &left[c], 4); memcpy(&r, &right[c], 4);
+          p = le32(le32(p, l), r);
+        }
+      } break;
+      case AUDIO_WAV_16:
+        for(size_t c = 0; c < n; c++)
+          p = le16(le16(p, quantize(left[c], 32767.0f)), quantize(right[c], 32767.0f));
+        break;
+      case AUDIO_WAV_24:
+        for(size_t c = 0; c < n; c++)
+          p = le24(le24(p, quantize(left[c], 8388607.0f)), quantize(right[c], 8388607.0f));
+        break;
+    }
+    used = p - &buffer[0];
+    frames += n;
+    left += n; right += n; count -= n;
+    if (used >= FLUSH_BYTES)
+      flush();
+  }
+}
+
+void AudioWriter::close() {
+  if (!file)
+    return;
+  flush();
+  if (format != AUDIO_RAW_FLOAT) {
+    uint64_t dataBytes = frames*2*bytesPerSample;
+    if (dataBytes & 1) { // Chunks are padded to even length
+      uint8_t pad = 0;
+      fwrite(&pad, 1, 1, file);
+    }
+    long end = ftell(file);
+    put32(4, (uint32_t)(end - 8));
+    if (factAt >= 0)
+      put32(factAt, (uint32_t)frames);
+    put32(dataAt, (uint32_t)dataBytes);
+  }
+  if (ownFile)
+    fclose(file);
+  else
+    fflush(file);
+  file = NULL;
+}
+
+bool WavReader::open(const char *path) {
+  file = fopen(path, "rb");
+  if (!file) return fail(std::string("couldn't open ") + path);
+  uint8_t h[12];
+  if (fread(h, 1, 12, file) != 12 || memcmp(h, "RIFF", 4) || memcmp(h+8, "WAVE", 4))
+    return fail("not a WAV file");
+  bool haveFormat = false;
+  while (1) {
+    uint8_t chunk[8];
+    if (fread(chunk, 1, 8, file) != 8)
+      return fail("no data chunk");
+    uint32_t size = le(chunk+4, 4);
+    if (!memcmp(chunk, "fmt ", 4)) {
+      std::vector<uint8_t> fmt(size < 40 ? 40 : size, 0);
+      if (size < 16 || fread(&fmt[0], 1, size, file) != size)
+        return fail("bad fmt chunk");
+      uint32_t tag = le(&fmt[0], 2);
+      if (tag == 0xFFFE && size >= 26) // WAVE_FORMAT_EXTENSIBLE: real tag starts the subformat GUID
+        tag = le(&fmt[24], 2);
+      channels = le(&fmt[2], 2);
+      sampleRate = le(&fmt[4], 4);
+      bytesPerSample = le(&fmt[14], 2) / 8;
+      isFloat = tag == 3;
+      if ((tag != 1 && tag != 3) || channels < 1 || bytesPerSample < 1 || bytesPerSample > 4 || (isFloat && bytesPerSample != 4))
+        return fail("unsupported sample format (need PCM 8-32 bit or float32)");
+      haveFormat = true;
+      if (size & 1) fseek(file, 1, SEEK_CUR);
+    } else if (!memcmp(chunk, "data", 4)) {
+      if (!haveFormat)
+        return fail("data chunk before fmt chunk");
+      framesLeft = size / (channels*bytesPerSample);
+      return true;
+    } else {
+      fseek(file, size + (size & 1), SEEK_CUR);
+    }
+  }
+}
+
+size_t WavReader::read(float *stereo, size_t count) {
+  if (!file) return 0;
+  if (count > framesLeft) count = framesLeft;
+  size_t frameBytes = channels*bytesPerSample;
+  raw.resize(count*frameBytes);
+  count = count ? fread(&raw[0], frameBytes, count, file) : 0;
+  framesLeft -= count;
+  const uint8_t *p = count ? &raw[0] : NULL;
+  for(size_t c = 0; c < count; c++, p += frameBytes) {
+    stereo[2*c] = sample(p);
+    stereo[2*c+1] = channels > 1 ? sample(p + bytesPerSample) : stereo[2*c];
+  }
+  return count;
+}
@@ -0,0 +1,135 @@
+#ifndef __driver_wavFile_hpp__
+#define __driver_wavFile_hpp__
+
+// Buffered stereo output for MagusSim: headerless native floats, or a WAV file
+// (float32, 16 or 24 bit) whose header sizes are filled in on close.
+// Also a reader for PCM and float WAV files of any channel count.
+// License https://creativecommons.org/publicdomain/zero/1.0/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+#include <vector>
+
+enum AudioFormat {
+  AUDIO_RAW_FLOAT, // Native-endian interleaved float, no header
+  AUDIO_WAV_FLOAT,
+  AUDIO_WAV_16,
+  AUDIO_WAV_24,
+};
+
+struct StereoFrame {
+  float left, right;
+};
+
+class AudioWriter {
+  FILE *file;
+  bool ownFile;
+  AudioFormat format;
+  int bytesPerSample;
+  std::vector<uint8_t> buffer; // Interleaved output waiting for fwrite
+  size_t used;
+  uint64_t frames;       // Stereo frames written so far
+  long factAt, dataAt;   // Offsets of size fields to patch on close
+
+  static const size_t FLUSH_BYTES = 1 << 20;
+
+  static uint8_t *le16(uint8_t *p, uint32_t v) { p[0] = v; p[1] = v >> 8; return p+2; }
+  static uint8_t *le24(uint8_t *p, uint32_t v) { p[0] = v; p[1] = v >> 8; p[2] = v >> 16; return p+3; }
+  static uint8_t *le32(uint8_t *p, uint32_t v) { p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24; return p+4; }
+
+  static int32_t quantize(float v, float scale) {
+    if (!(v > -1.0f)) v = -1.0f; // Also catches NaN
+    if (v > 1.0f) v = 1.0f;
+    return (int32_t)lrintf(v*scale);
+  }
+
+  void put32(long at, uint32_t v) {
+    uint8_t bytes[4];
+    le32(bytes, v);
+    fseek(file, at, SEEK_SET);
+    fwrite(bytes, 1, 4, file);
+  }
+
+  void writeHeader(float sampleRate);
+
+public:
+  AudioWriter() : file(NULL), ownFile(false), format(AUDIO_RAW_FLOAT), bytesPerSample(4), used(0), frames(0) {}
+  ~AudioWriter() { close(); }
+
+  // Path NULL means stdout, which is only allowed for AUDIO_RAW_FLOAT
+  bool open(const char *path, AudioFormat _format, float sampleRate);
+
+  void flush() {
+    if (used)
+      fwrite(&buffer[0], 1, used, file);
+    used = 0;
+  }
+
+  // Interleave one block straight into the write buffer
+  void write(const float *left, const float *right, size_t count);
+
+  // Flush, and for WAV go back and fill in the chunk sizes
+  void close();
+};
+
+class WavReader {
+  FILE *file;
+  int channels, bytesPerSample;
+  bool isFloat;
+  float sampleRate;
+  uint64_t framesLeft;
+  std::vector<uint8_t> raw;
+  std::string error;
+
+  static uint32_t le(const uint8_t *p, int bytes) {
+    uint32_t v = 0;
+    for(int c = bytes-1; c >= 0; c--)
+      v = (v << 8) | p[c];
+    return v;
+  }
+  bool fail(const std::string &why) {
+    error = why;
+    return false;
+  }
+
+  float sample(const uint8_t *p) {
+    if (isFloat) {
+      float f;
+      uint32_t bits = le(p, 4);
+      memcpy(&f, &bits, 4);
+      return f;
+    }
+    switch (bytesPerSample) {
+      case 1: return (p[0] - 128) / 128.0f;
+      case 2: return (int16_t)le(p, 2) / 32768.0f;
+      case 3: return ((int32_t)(le(p, 3) << 8) >> 8) / 8388608.0f;
+      default: return (int32_t)le(p, 4) / 2147483648.0f;
+    }
+  }
+
+public:
+  WavReader() : file(NULL), channels(0), bytesPerSample(0), isFloat(false), sampleRate(0), framesLeft(0) {}
+  ~WavReader() { close(); }
+
+  const std::string &getError() { return error; }
+  float getSampleRate() { return sampleRate; }
+  int getChannels() { return channels; }
+
+  // Reads the header and leaves the file positioned at the first sample
+  bool open(const char *path);
+
+  // Read up to count frames as interleaved stereo. Mono is copied to both sides and
+  // channels past the second are dropped. Returns frames read, 0 at end of file.
+  size_t read(float *stereo, size_t count);
+
+  void close() {
+    if (file)
+      fclose(file);
+    file = NULL;
+  }
+};
+
+#endif // __driver_wavFile_hpp__
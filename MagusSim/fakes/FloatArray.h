@@ -0,0 +1,193 @@
+#ifndef __fakes_FloatArray_hpp__
+#define __fakes_FloatArray_hpp__
+
+// Stand-in for OwlProgram's FloatArray, with the same vector operations. The simulator's
+// versions are written four floats at a time with GCC/Clang vector types, which the host
+// compiler turns into SSE or NEON instructions. They are not a model of the device's speed.
+// Loads and stores go through memcpy, so sub-arrays at any offset are fine; create() and
+// AudioBuffer storage are 64-byte aligned so whole buffers never straddle a cache line.
+// License https://creativecommons.org/publicdomain/zero/1.0/
+
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+#include <new>
+#include <algorithm>
+
+#define SIM_FLOAT_ALIGN 64
+
+typedef float SimFloat4 __attribute__((vector_size(16)));
+
+static inline SimFloat4 _simLoad4(const float *p) { SimFloat4 v; memcpy(&v, p, sizeof(v)); return v; }
+static inline void _simStore4(float *p, SimFloat4 v) { memcpy(p, &v, sizeof(v)); }
+static inline SimFloat4 _simSplat4(float s) { SimFloat4 v = {s, s, s, s}; return v; }
+
+// The same generic lambda is used for the vector body and the scalar tail, so these helpers
+// need one overload per type
+static inline float _simMin(float a, float b) { return a < b ? a : b; }
+static inline float _simMax(float a, float b) { return a > b ? a : b; }
+static inline SimFloat4 _simMin(SimFloat4 a, SimFloat4 b) { return a < b ? a : b; }
+static inline SimFloat4 _simMax(SimFloat4 a, SimFloat4 b) { return a > b ? a : b; }
+static inline SimFloat4 _simMin(SimFloat4 a, float b) { return _simMin(a, _simSplat4(b)); }
+static inline SimFloat4 _simMax(SimFloat4 a, float b) { return _simMax(a, _simSplat4(b)); }
+static inline float _simAdd(float a, float b) { return a + b; }
+static inline float _simAbs(float a) { return fabsf(a); }
+static inline SimFloat4 _simAbs(SimFloat4 a) { return a < 0 ? -a : a; }
+
+// out[c] = op(a[c]) and out[c] = op(a[c], b[c]). out may be a or b.
+template<typename Op> static inline void _simMap(const float *a, float *out, size_t n, Op op) {
+  size_t c = 0;
+  for(; c + 4 <= n; c += 4)
+    _simStore4(out + c, op(_simLoad4(a + c)));
+  for(; c < n; c++)
+    out[c] = op(a[c]);
+}
+template<typename Op> static inline void _simZip(const float *a, const float *b, float *out, size_t n, Op op) {
+  size_t c = 0;
+  for(; c + 4 <= n; c += 4)
+    _simStore4(out + c, op(_simLoad4(a + c), _simLoad4(b + c)));
+  for(; c < n; c++)
+    out[c] = op(a[c], b[c]);
+}
+// Folds op(acc, a[c]) into four lanes, then joins the lanes with combine (+ for sums)
+template<typename Op, typename Combine> static inline float _simFold(const float *a, size_t n, float init, Op op, Combine combine) {
+  SimFloat4 lanes = _simSplat4(init);
+  size_t c = 0;
+  for(; c + 4 <= n; c += 4)
+    lanes = op(lanes, _simLoad4(a + c));
+  float acc = combine(combine(lanes[0], lanes[1]), combine(lanes[2], lanes[3]));
+  for(; c < n; c++)
+    acc = op(acc, a[c]);
+  return acc;
+}
+
+struct FloatArray {
+  size_t _size;
+  float *_data;
+
+  FloatArray() : _size(0), _data(NULL) {}
+  FloatArray(float *data, size_t size) : _size(size), _data(data) {}
+
+  void _clear() { clear(); }
+
+  float *getData() { return _data; }
+  size_t getSize() const { return _size; }
+  float &operator[](size_t index) { return _data[index]; }
+  const float &operator[](size_t index) const { return _data[index]; }
+  operator float*() { return _data; }
+
+  void clear() { memset(_data, 0, _size*sizeof(float)); }
+  void setAll(float value) { std::fill(_data, _data + _size, value); }
+
+  // Statistics. As in OwlProgram, min/max report the first index on ties.
+  void getMin(float *value, int *index) {
+    float best = getMinValue();
+    int at = -1;
+    for(size_t c = 0; c < _size && at < 0; c++)
+      if (_data[c] == best) at = c;
+    *value = best;
+    *index = at;
+  }
+  void getMax(float *value, int *index) {
+    float best = getMaxValue();
+    int at = -1;
+    for(size_t c = 0; c < _size && at < 0; c++)
+      if (_data[c] == best) at = c;
+    *value = best;
+    *index = at;
+  }
+  float getMinValue() {
+    auto op = [](auto a, auto b) { return _simMin(a, b); };
+    return _size ? _simFold(_data, _size, _data[0], op, op) : 0;
+  }
+  float getMaxValue() {
+    auto op = [](auto a, auto b) { return _simMax(a, b); };
+    return _size ? _simFold(_data, _size, _data[0], op, op) : 0;
+  }
+  int getMinIndex() { float v; int i; getMin(&v, &i); return i; }
+  int getMaxIndex() { float v; int i; getMax(&v, &i); return i; }
+  float getSum() {
+    auto op = [](auto a, auto b) { return a + b; };
+    return _simFold(_data, _size, 0, op, op);
+  }
+  float getMean() { return _size ? getSum()/_size : 0; }
+  float getPower() { return _simFold(_data, _size, 0, [](auto a, auto b) { return a + b*b; }, _simAdd); }
+  float getRms() { return _size ? sqrtf(getPower()/_size) : 0; }
+  float getVariance() {
+    if (_size < 2) return 0;
+    float mean = getMean();
+    float sum = _simFold(_data, _size, 0, [mean](auto a, auto b) { return a + (b - mean)*(b - mean); }, _simAdd);
+    return sum/(_size - 1);
+  }
+  float getStandardDeviation() { return sqrtf(getVariance()); }
+
+  // Elementwise. Each has an in-place form and one that writes to destination.
+  void rectify(FloatArray &destination) { _simMap(_data, destination._data, _size, [](auto a) { return _simAbs(a); }); }
+  void rectify() { rectify(*this); }
+  void negate(FloatArray &destination) { _simMap(_data, destination._data, _size, [](auto a) { return -a; }); }
+  void negate() { negate(*this); }
+  void reciprocal(FloatArray &destination) { _simMap(_data, destination._data, _size, [](auto a) { return 1.0f/a; }); }
+  void reciprocal() { reciprocal(*this); }
+  void reverse(FloatArray &destination) {
+    if (destination._data == _data) {
+      std::reverse(_data, _data + _size);
+    } else {
+      for(size_t c = 0; c < _size; c++)
+        destination._data[c] = _data[_size - 1 - c];
+    }
+  }
+  void reverse() { reverse(*this); }
+
+  void clip() { clip(-1, 1); }
+  void clip(float range) { clip(-range, range); }
+  void clip(float min, float max) {
+    _simMap(_data, _data, _size, [min, max](auto a) { return _simMin(_simMax(a, min), max); });
+  }
+
+  void add(FloatArray operand2, FloatArray destination) { _simZip(_data, operand2._data, destination._data, _size, [](auto a, auto b) { return a + b; }); }
+  void add(FloatArray operand2) { add(operand2, *this); }
+  void add(float scalar, FloatArray destination) { _simMap(_data, destination._data, _size, [scalar](auto a) { return a + scalar; }); }
+  void add(float scalar) { add(scalar, *this); }
+  void subtract(FloatArray operand2, FloatArray destination) { _simZip(_data, operand2._data, destination._data, _size, [](auto a, auto b) { return a - b; }); }
+  void subtract(FloatArray operand2) { subtract(operand2, *this); }
+  void subtract(float scalar, FloatArray destination) { _simMap(_data, destination._data, _size, [scalar](auto a) { return a - scalar; }); }
+  void subtract(float scalar) { subtract(scalar, *this); }
+  void multiply(FloatArray operand2, FloatArray destination) { _simZip(_data, operand2._data, destination._data, _size, [](auto a, auto b) { return a * b; }); }
+  void multiply(FloatArray operand2) { multiply(operand2, *this); }
+  void multiply(float scalar, FloatArray destination) { _simMap(_data, destination._data, _size, [scalar](auto a) { return a * scalar; }); }
+  void multiply(float scalar) { multiply(scalar, *this); }
+
+  // Copies. Sizes are the smaller of the two arrays, as OwlProgram asserts they match.
+  void copyTo(float *other, size_t length) { memcpy(other, _data, std::min(length, _size)*sizeof(float)); }
+  void copyFrom(const float *other, size_t length) { memcpy(_data, other, std::min(length, _size)*sizeof(float)); }
+  void copyTo(FloatArray destination) { copyTo(destination._data, destination._size); }
+  void copyFrom(FloatArray source) { copyFrom(source._data, source._size); }
+  void insert(FloatArray source, int sourceOffset, int destinationOffset, size_t samples) {
+    memcpy(_data + destinationOffset, source._data + sourceOffset, samples*sizeof(float));
+  }
+  void insert(FloatArray source, int destinationOffset, size_t samples) { insert(source, 0, destinationOffset, samples); }
+  void move(int fromIndex, int toIndex, size_t length) { memmove(_data + toIndex, _data + fromIndex, length*sizeof(float)); }
+  FloatArray subArray(int offset, size_t length) { return FloatArray(_data + offset, length); }
+
+  bool equals(const FloatArray &other) const {
+    return _size == other._size && (_data == other._data || !memcmp(_data, other._data, _size*sizeof(float)));
+  }
+
+  // Aligned storage, zeroed. Free with destroy().
+  static FloatArray create(int size) {
+    FloatArray array((float *)_allocate(size*sizeof(float)), size);
+    array.clear();
+    return array;
+  }
+  static void destroy(FloatArray array) { _free(array._data); }
+
+  static void *_allocate(size_t bytes) {
+    bytes = (bytes + SIM_FLOAT_ALIGN - 1) & ~(size_t)(SIM_FLOAT_ALIGN - 1);
+    return ::operator new(bytes ? bytes : SIM_FLOAT_ALIGN, std::align_val_t(SIM_FLOAT_ALIGN));
+  }
+  static void _free(void *p) {
+    if (p) ::operator delete(p, std::align_val_t(SIM_FLOAT_ALIGN));
+  }
+};
+
+#endif
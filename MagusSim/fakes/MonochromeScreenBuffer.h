@@ -0,0 +1,147 @@
+#ifndef __fakes_MonochromeScreenBuffer_hpp__
+#define __fakes_MonochromeScreenBuffer_hpp__
+
+// Stand-in for OwlProgram's MonochromeScreenBuffer: a 128x64 1-bit display, stored in
+// the same 8-rows-per-byte page layout the Magus screen uses, with a 6x8 text console.
+// Text is drawn with the classic 5x7 GLCD font. As on the device, print(x, y, ...)
+// puts the bottom of the text at y, so the first console line is at y=8.
+// License https://creativecommons.org/publicdomain/zero/1.0/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifndef BLACK
+#define BLACK 0
+#define WHITE 1
+#endif
+typedef uint8_t Colour;
+
+#define SCREEN_WIDTH 128
+#define SCREEN_HEIGHT 64
+
+// 5 columns per glyph, LSB at the top, ASCII 0x20-0x7E
+static const uint8_t glcdFont[95][5] = {
+  {0x00,0x00,0x00,0x00,0x00}, {0x00,0x00,0x5F,0x00,0x00}, {0x00,0x07,0x00,0x07,0x00}, {0x14,0x7F,0x14,0x7F,0x14}, // ' ' ! " #
+  {0x24,0x2A,0x7F,0x2A,0x12}, {0x23,0x13,0x08,0x64,0x62}, {0x36,0x49,0x55,0x22,0x50}, {0x00,0x05,0x03,0x00,0x00}, // $ % & '
+  {0x00,0x1C,0x22,0x41,0x00}, {0x00,0x41,0x22,0x1C,0x00}, {0x08,0x2A,0x1C,0x2A,0x08}, {0x08,0x08,0x3E,0x08,0x08}, // ( ) * +
+  {0x00,0x50,0x30,0x00,0x00}, {0x08,0x08,0x08,0x08,0x08}, {0x00,0x60,0x60,0x00,0x00}, {0x20,0x10,0x08,0x04,0x02}, // , - . /
+  {0x3E,0x51,0x49,0x45,0x3E}, {0x00,0x42,0x7F,0x40,0x00}, {0x42,0x61,0x51,0x49,0x46}, {0x21,0x41,0x45,0x4B,0x31}, // 0 1 2 3
+  {0x18,0x14,0x12,0x7F,0x10}, {0x27,0x45,0x45,0x45,0x39}, {0x3C,0x4A,0x49,0x49,0x30}, {0x01,0x71,0x09,0x05,0x03}, // 4 5 6 7
+  {0x36,0x49,0x49,0x49,0x36}, {0x06,0x49,0x49,0x29,0x1E}, {0x00,0x36,0x36,0x00,0x00}, {0x00,0x56,0x36,0x00,0x00}, // 8 9 : ;
+  {0x08,0x14,0x22,0x41,0x00}, {0x14,0x14,0x14,0x14,0x14}, {0x00,0x41,0x22,0x14,0x08}, {0x02,0x01,0x51,0x09,0x06}, // < = > ?
+  {0x32,0x49,0x79,0x41,0x3E}, {0x7E,0x11,0x11,0x11,0x7E}, {0x7F,0x49,0x49,0x49,0x36}, {0x3E,0x41,0x41,0x41,0x22}, // @ A B C
+  {0x7F,0x41,0x41,0x22,0x1C}, {0x7F,0x49,0x49,0x49,0x41}, {0x7F,0x09,0x09,0x09,0x01}, {0x3E,0x41,0x49,0x49,0x7A}, // D E F G
+  {0x7F,0x08,0x08,0x08,0x7F}, {0x00,0x41,0x7F,0x41,0x00}, {0x20,0x40,0x41,0x3F,0x01}, {0x7F,0x08,0x14,0x22,0x41}, // H I J K
+  {0x7F,0x40,0x40,0x40,0x40}, {0x7F,0x02,0x0C,0x02,0x7F}, {0x7F,0x04,0x08,0x10,0x7F}, {0x3E,0x41,0x41,0x41,0x3E}, // L M N O
+  {0x7F,0x09,0x09,0x09,0x06}, {0x3E,0x41,0x51,0x21,0x5E}, {0x7F,0x09,0x19,0x29,0x46}, {0x46,0x49,0x49,0x49,0x31}, // P Q R S
+  {0x01,0x01,0x7F,0x01,0x01}, {0x3F,0x40,0x40,0x40,0x3F}, {0x1F,0x20,0x40,0x20,0x1F}, {0x3F,0x40,0x38,0x40,0x3F}, // T U V W
+  {0x63,0x14,0x08,0x14,0x63}, {0x07,0x08,0x70,0x08,0x07}, {0x61,0x51,0x49,0x45,0x43}, {0x00,0x7F,0x41,0x41,0x00}, // X Y Z [
+  {0x02,0x04,0x08,0x10,0x20}, {0x00,0x41,0x41,0x7F,0x00}, {0x04,0x02,0x01,0x02,0x04}, {0x40,0x40,0x40,0x40,0x40}, // \ ] ^ _
+  {0x00,0x01,0x02,0x04,0x00}, {0x20,0x54,0x54,0x54,0x78}, {0x7F,0x48,0x44,0x44,0x38}, {0x38,0x44,0x44,0x44,0x20}, // ` a b c
+  {0x38,0x44,0x44,0x48,0x7F}, {0x38,0x54,0x54,0x54,0x18}, {0x08,0x7E,0x09,0x01,0x02}, {0x0C,0x52,0x52,0x52,0x3E}, // d e f g
+  {0x7F,0x08,0x04,0x04,0x78}, {0x00,0x44,0x7D,0x40,0x00}, {0x20,0x40,0x44,0x3D,0x00}, {0x7F,0x10,0x28,0x44,0x00}, // h i j k
+  {0x00,0x41,0x7F,0x40,0x00}, {0x7C,0x04,0x18,0x04,0x78}, {0x7C,0x08,0x04,0x04,0x78}, {0x38,0x44,0x44,0x44,0x38}, // l m n o
+  {0x7C,0x14,0x14,0x14,0x08}, {0x08,0x14,0x14,0x18,0x7C}, {0x7C,0x08,0x04,0x04,0x08}, {0x48,0x54,0x54,0x54,0x20}, // p q r s
+  {0x04,0x3F,0x44,0x40,0x20}, {0x3C,0x40,0x40,0x20,0x7C}, {0x1C,0x20,0x40,0x20,0x1C}, {0x3C,0x40,0x30,0x40,0x3C}, // t u v w
+  {0x44,0x28,0x10,0x28,0x44}, {0x0C,0x50,0x50,0x50,0x3C}, {0x44,0x64,0x54,0x4C,0x44}, {0x00,0x08,0x36,0x41,0x00}, // x y z {
+  {0x00,0x00,0x7F,0x00,0x00}, {0x00,0x41,0x36,0x08,0x00}, {0x08,0x04,0x08,0x10,0x08},                              // | } ~
+};
+
+class MonochromeScreenBuffer {
+  uint8_t pixels[SCREEN_WIDTH*SCREEN_HEIGHT/8];
+  int cursorX, cursorY;
+  Colour textColour, textBackground;
+
+public:
+  MonochromeScreenBuffer() : cursorX(0), cursorY(8), textColour(WHITE), textBackground(BLACK) {
+    clear();
+  }
+
+  int getWidth() { return SCREEN_WIDTH; }
+  int getHeight() { return SCREEN_HEIGHT; }
+  uint8_t *getBuffer() { return pixels; }
+
+  void fill(Colour c) { memset(pixels, c ? 0xFF : 0x00, sizeof(pixels)); }
+  void clear() { fill(BLACK); }
+  void invert() {
+    for(size_t c = 0; c < sizeof(pixels); c++)
+      pixels[c] = ~pixels[c];
+  }
+
+  Colour getPixel(unsigned int x, unsigned int y) {
+    if (x >= SCREEN_WIDTH || y >= SCREEN_HEIGHT) return BLACK;
+    return (pixels[x + (y/8)*SCREEN_WIDTH] >> (y&7)) & 1;
+  }
+  void setPixel(unsigned int x, unsigned int y, Colour c) {
+    if (x >= SCREEN_WIDTH || y >= SCREEN_HEIGHT) return;
+    uint8_t &b = pixels[x + (y/8)*SCREEN_WIDTH];
+    if (c) b |= 1 << (y&7);
+    else   b &= ~(1 << (y&7));
+  }
+
+  void setCursor(int x, int y) { cursorX = x; cursorY = y; }
+  void setTextColour(Colour fg) { textColour = fg; textBackground = fg; } // As OwlProgram: transparent background
+  void setTextColour(Colour fg, Colour bg) { textColour = fg; textBackground = bg; }
+
+  // Draw one 6x8 cell with its bottom row at cursorY-1, then advance
+  void write(uint8_t c) {
+    if (c == '\n') {
+      cursorX = 0;
+      cursorY += 8;
+      return;
+    }
+    if (c == '\r')
+      return;
+    const uint8_t *glyph = (c >= 0x20 && c < 0x7F) ? glcdFont[c - 0x20] : glcdFont['?' - 0x20];
+    int top = cursorY - 8;
+    for(int col = 0; col < 6; col++) {
+      uint8_t bits = col < 5 ? glyph[col] : 0;
+      for(int row = 0; row < 8; row++) {
+        bool on = (bits >> row) & 1;
+        if (on)
+          setPixel(cursorX + col, top + row, textColour);
+        else if (textBackground != textColour)
+          setPixel(cursorX + col, top + row, textBackground);
+      }
+    }
+    cursorX += 6;
+  }
+  void print(const char *s) {
+    while (*s)
+      write((uint8_t)*s++);
+  }
+  void print(int x, int y, const char *s) {
+    setCursor(x, y);
+    print(s);
+  }
+  void print(int num) {
+    char scratch[12];
+    snprintf(scratch, sizeof(scratch), "%d", num);
+    print(scratch);
+  }
+  void print(float num) {
+    char scratch[24];
+    snprintf(scratch, sizeof(scratch), "%g", num);
+    print(scratch);
+  }
+
+  // Dump as a binary PBM (P4) image; in PBM 1 is black, so lit pixels are written as 0
+  bool writePbm(const char *path) {
+    FILE *f = fopen(path, "wb");
+    if (!f) return false;
+    fprintf(f, "P4\n%d %d\n", SCREEN_WIDTH, SCREEN_HEIGHT);
+    uint8_t row[SCREEN_WIDTH/8];
+    for(int y = 0; y < SCREEN_HEIGHT; y++) {
+      memset(row, 0, sizeof(row));
+      for(int x = 0; x < SCREEN_WIDTH; x++)
+        if (!getPixel(x, y))
+          row[x/8] |= 0x80 >> (x&7);
+      fwrite(row, 1, sizeof(row), f);
+    }
+    fclose(f);
+    return true;
+  }
+};
+
+#endif // __fakes_MonochromeScreenBuffer_hpp__
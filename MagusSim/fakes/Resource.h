@@ -0,0 +1,74 @@
+#ifndef __fakes_Resource_hpp__
+#define __fakes_Resource_hpp__
+
+// Stand-in for OwlProgram's Resource. Resources are files in the simulator's resource
+// directory (--resources), mapped read-only so getData() points straight at the file.
+// Bare-metal builds (SIM_BARE_METAL) have no files to map, so there are no resources.
+// License https://creativecommons.org/publicdomain/zero/1.0/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#ifndef SIM_BARE_METAL
+#include <chrono>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+extern const char *_simResourceDir;
+void _simResourceLoaded(const char *name, size_t size, uint64_t ns, bool found); // Driver keeps stats
+#endif
+
+class Resource {
+  std::string name;
+  void *data;
+  size_t size;
+
+  Resource(const char *_name, void *_data, size_t _size) : name(_name), data(_data), size(_size) {}
+  ~Resource() {
+#ifndef SIM_BARE_METAL
+    if (data)
+      munmap(data, size);
+#endif
+  }
+
+public:
+  const char *getName() { return name.c_str(); }
+  size_t getSize() { return size; }
+  void *getData() { return data; }
+  bool hasData() { return data != NULL; }
+
+  // Returns NULL if there is no such resource
+  static Resource *load(const char *name) {
+#ifdef SIM_BARE_METAL
+    (void)name;
+    return NULL;
+#else
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::string path = std::string(_simResourceDir) + "/" + name;
+    Resource *result = NULL;
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd >= 0) {
+      struct stat st;
+      if (fstat(fd, &st) == 0) {
+        size_t size = st.st_size;
+        void *data = size ? mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0) : NULL;
+        if (data != MAP_FAILED)
+          result = new Resource(name, data, size);
+      }
+      ::close(fd);
+    }
+    uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    _simResourceLoaded(name, result ? result->size : 0, ns, result != NULL);
+    return result;
+#endif
+  }
+  static Resource *open(const char *name) { return load(name); }
+
+  static void destroy(Resource *resource) {
+    delete resource;
+  }
+};
+
+#endif // __fakes_Resource_hpp__
@@ -142,18 +142,34 @@ public:
     }
   }
 
+#ifdef OWL_SIMULATOR
+  const char *_simCheckInvariants() { // Every output still marked present should be playing a note that's down
+    const char *problem = MidiPatchBase::_simCheckInvariants();
+    if (problem)
+      return problem;
+    for(int o = 0; o < MIDI_OUTS; o++) {
+      PackedHistory &out = outHistory[o];
+      if (!out.present)
+        continue;
+      bool held = false;
+      for(int c = 0; c < downCount; c++)
+        held = held || midiDown[c] == out.lastMidi;
+      if (!held)
+        return "an output is present but its note isn't down";
+    }
+    return NULL;
+  }
+#endif
+
   void processAudio(AudioBuffer& buffer) { // Create CV/Gate from notes down
     FloatArray left = buffer.getSamples(LEFT_CHANNEL);
     FloatArray right = buffer.getSamples(RIGHT_CHANNEL);
 
     // Buffers
     int size = min(left.getSize(), right.getSize());
-    float *leftData = left.getData();
-    float *rightData = right.getData();
-
     int assign = lastMidi;
     int lastFoundAssign = -1;
-    float lastValue;
+    float lastValue = 0; // Set by the first output below
     bool trig;
 
     PatchParameterId param = patchForSlot(PARAM_BASE);
@@ -183,17 +199,14 @@ public:
 
 #if AUDIO_OUT
     float trigValue = trig ? 1.0f : 0.0f;
-    for(int c = 0; c < size; c++) {
-      leftData[c] = trigValue;
-      rightData[c] = lastValue;
-    }
+    left.setAll(trigValue);
+    right.setAll(lastValue);
 #else
-    memset(leftData, 0, size*sizeof(float));
-    memset(rightData, 0, size*sizeof(float));
+    left.clear();
+    right.clear();
 #endif
   }
 
-#ifndef OWL_SIMULATOR
   void processScreen(MonochromeScreenBuffer& screen){ // Print notes-playing array
     int uniqueNotes = highestSeniority()+1;
 //debugMessage("Note count", downCount);
@@ -225,7 +238,6 @@ public:
       }
     }
   }
-#endif
 
 };
 
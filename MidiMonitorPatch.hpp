@@ -29,7 +29,6 @@ public:
   ~MidiMonitorPatch(){
   }
 
-#ifndef OWL_SIMULATOR
   void processMidi(MidiMessage msg){
     if (messageLineCount > MESSAGELINES)
       messageLineCount = MESSAGELINES; // Should be impossible
@@ -118,7 +117,6 @@ public:
       cury += CONSOLE_STEP_Y;
     }
   }
-#endif
 
   void buttonChanged(PatchButtonId bid, uint16_t value, uint16_t samples){
   }
@@ -128,14 +126,9 @@ public:
     FloatArray left = buffer.getSamples(LEFT_CHANNEL);
     FloatArray right = buffer.getSamples(RIGHT_CHANNEL);
 
-    // Buffers
-    int size = min(left.getSize(), right.getSize());
-    float *leftData = left.getData();
-    float *rightData = right.getData();
-
     // Write sample
-    memset(leftData,  0, size*sizeof(float));
-    memset(rightData, 0, size*sizeof(float));
+    left.clear();
+    right.clear();
   }
 };
 
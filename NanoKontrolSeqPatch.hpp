@@ -8,6 +8,11 @@
 #include "OpenWareMidiControl.h"
 #include "MonochromeScreenPatch.h"
 #include "support/display.h"
+#include "support/profile.h"
+
+PROFILE_SECTION(clickTrack)
+PROFILE_SECTION(step)
+PROFILE_SECTION(lights)
 
 // Constants
 
@@ -289,8 +294,12 @@ public:
   unvirtual void loadResource(int _songId) {
     songId = _songId;
     char name[12] = "nk2seqX.dat";
-    name[6] = songId+1;
+    name[6] = '1'+songId; // The digit, so song 0 is nk2seq1.dat; songId+1 alone made a control character
+#ifdef OWL_SIMULATOR
+    Resource* resource = getResource(name); // Simulator maps these from its --resources directory
+#else
     Resource* resource = NULL; //getResource(name);
+#endif
     if (resource && resource->getSize() >= (sizeof(Song) + 4)) {
       uint8_t *data = (uint8_t *)resource->getData();
       //uint32_t *idWord = data;
@@ -299,12 +308,14 @@ public:
     } else {
       initSong(song);
     }
+    if (resource)
+      Resource::destroy(resource);
   }
 
   void saveResource() {
   #if 0
     char name[12] = "nk2seqX.dat";
-    name[6] = songId+1;
+    name[6] = '1'+songId;
     size_t size = sizeof(Song)+4;
     uint8_t *data = (uint8_t *)malloc(size);
     uint32_t *idWord = (uint32_t *)data;
@@ -644,8 +655,8 @@ debug1 = -1; debug2 = 0;
       rightData = right.getData();
 
       // Write sample
-      memset(leftData,  0, bufferSize*sizeof(float));
-      memset(rightData, 0, bufferSize*sizeof(float));
+      left.clear();
+      right.clear();
     }
 
     uint32_t timeStep = getBlockSize();
@@ -653,20 +664,23 @@ debug1 = -1; debug2 = 0;
       // Tick refers to "click track" code
       // This is WIP and pretty bad
       // The correct(?) way to do this is probably to make a 16th note one block
-      for(int ch = 0; ch < 2; ch++) {
-        int tickEvery = song.period;
-        int tickOffset = nextStep >= 0 ? song.period - nextStep : 0; // "progress" 
-        int8_t &tick = song.tick[ch];
-        if (tick < 0) {
-          tickEvery /= (-tick);
-          tickOffset %= tickEvery;
-        } else if (tick > 0) {
-          tickEvery *= tick;
-          tickOffset += song.period*(stepCount % tick);
-        }
-        for(int c = tickOffset; c < bufferSize; c += tickEvery) {
-          for(int d = 0; d < TICK_SUSTAIN && (c+d)<bufferSize; d++) {
-            (ch ? rightData : leftData)[c+d] = 1;
+      { // Click track
+        PROFILE_SCOPE(clickTrack);
+        for(int ch = 0; ch < 2; ch++) {
+          int tickEvery = song.period;
+          int tickOffset = nextStep >= 0 ? song.period - nextStep : 0; // "progress" 
+          int8_t &tick = song.tick[ch];
+          if (tick < 0) {
+            tickEvery /= (-tick);
+            tickOffset %= tickEvery;
+          } else if (tick > 0) {
+            tickEvery *= tick;
+            tickOffset += song.period*(stepCount % tick);
+          }
+          for(int c = tickOffset; c < bufferSize; c += tickEvery) {
+            for(int d = 0; d < TICK_SUSTAIN && (c+d)<bufferSize; d++) {
+              (ch ? rightData : leftData)[c+d] = 1;
+            }
           }
         }
       }
@@ -674,6 +688,7 @@ debug1 = -1; debug2 = 0;
       nextStep -= timeStep;
 
       if (nextStep <= 0) {
+        PROFILE_SCOPE(step);
         readyLights();
 
         noteStep();
@@ -695,7 +710,10 @@ debug1 = -1; debug2 = 0;
         }
       }
     }
-    updateLights(); // Catch any straggling light changes
+    {
+      PROFILE_SCOPE(lights);
+      updateLights(); // Catch any straggling light changes
+    }
   }
 
   // Print an integer, right-aligned
@@ -122,14 +122,9 @@ public:
     FloatArray left = buffer.getSamples(LEFT_CHANNEL);
     FloatArray right = buffer.getSamples(RIGHT_CHANNEL);
 
-    // Buffers
-    int size = min(left.getSize(), right.getSize());
-    float *leftData = left.getData();
-    float *rightData = right.getData();
-
     // Write sample
-    memset(leftData,  0, size*sizeof(float));
-    memset(rightData, 0, size*sizeof(float));
+    left.clear();
+    right.clear();
   } 
 };
 
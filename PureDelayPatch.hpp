@@ -52,7 +52,6 @@ public:
   }
 
 
-#ifndef OWL_SIMULATOR
   void processMidi(MidiMessage msg){
     switch (msg.getStatus()) {
       // Key on
@@ -62,7 +61,6 @@ public:
       default:break;
     }
   }
-#endif
 
   void buttonChanged(PatchButtonId bid, uint16_t value, uint16_t samples){
   }
@@ -94,12 +92,16 @@ public:
     float monitorLoud = getParameterValue(MONITORLOUD);
     float comonitorLoud = getParameterValue(COMONITORLOUD);
 
-    for(int i = 0; i < size; i++ ) {
-      float sample = CLAMP((leftData[i] + rightData[i])*inputLoud);
-
-      history[writePtr++] = sample;
-      writePtr %= BUFSIZE;
-    }
+    // Mix the input down into right, then append it to the history ring. right is free to use
+    // as scratch: the loop below only reads left and history, and writes every sample of right.
+    right.add(left);
+    right.multiply(inputLoud);
+    right.clip();
+    FloatArray historyArray(history, BUFSIZE);
+    int firstPart = min(size, BUFSIZE - writePtr);
+    historyArray.insert(right, 0, writePtr, firstPart);
+    historyArray.insert(right, firstPart, 0, size - firstPart);
+    writePtr = (writePtr + size) % BUFSIZE;
 
     int back = backLook();
     int from = writePtr - back - size + 2*BUFSIZE;
@@ -78,7 +78,6 @@ public:
   ~Saw4Patch(){
   }
 
-#ifndef OWL_SIMULATOR
   void processMidi(MidiMessage msg){
     switch (msg.getStatus()) {
       // Key on
@@ -88,7 +87,6 @@ public:
       default:break;
     }
   }
-#endif
 
   void buttonChanged(PatchButtonId bid, uint16_t value, uint16_t samples){
   }
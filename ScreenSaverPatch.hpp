@@ -56,17 +56,11 @@ public:
     FloatArray left = buffer.getSamples(LEFT_CHANNEL);
     FloatArray right = buffer.getSamples(RIGHT_CHANNEL);
 
-    // Buffers
-    int size = min(left.getSize(), right.getSize());
-    float *leftData = left.getData();
-    float *rightData = right.getData();
-
     // Write sample
-    memset(leftData,  0, size*sizeof(float));
-    memset(rightData, 0, size*sizeof(float));
+    left.clear();
+    right.clear();
   }
 
-#ifndef OWL_SIMULATOR
   void processScreen(MonochromeScreenBuffer& screen){
     int height = screen.getHeight();
     int width = screen.getWidth();
@@ -88,9 +82,6 @@ public:
     screen.clear();
     screen.print(x, y, num);
   }
-#else
-  #error "This patch doesn't really work without a screen"
-#endif
 
 };
 
@@ -1,6 +1,5 @@
 #ifndef __support_display_hpp__
-
-#ifndef OWL_SIMULATOR
+#define __support_display_hpp__
 
 #ifndef BLACK
 #error "MonochromeScreenPatch must be included before including this file"
@@ -41,6 +40,4 @@ static void printNote(MonochromeScreenBuffer& screen, uint8_t note) {
   screen.write(octaveChar(note));
 }
 
-#endif
-
 #endif // __support_display_hpp__
\ No newline at end of file
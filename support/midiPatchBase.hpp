@@ -103,7 +103,25 @@ public:
   void buttonChanged(PatchButtonId bid, uint16_t value, uint16_t samples) {
   }
 
-#ifndef OWL_SIMULATOR
+#ifdef OWL_SIMULATOR
+  const char *_simCheckInvariants() { // Note stack must be a set of real notes, with the gate and CV following its top
+    if (downCount > MIDI_MAXDOWN)
+      return "downCount past MIDI_MAXDOWN";
+    for(int c = 0; c < downCount; c++) {
+      if (midiDown[c] > 127)
+        return "midiDown holds a value that isn't a note";
+      for(int d = c+1; d < downCount; d++)
+        if (midiDown[c] == midiDown[d])
+          return "midiDown holds the same note twice";
+    }
+    if (isDown != (downCount > 0))
+      return "gate doesn't match whether notes are down";
+    if (downCount > 0 && lastMidi != midiDown[downCount-1])
+      return "lastMidi isn't the top of midiDown";
+    return NULL;
+  }
+#endif
+
   void processScreen(MonochromeScreenBuffer& screen){ // Print notes-down stack
 //debugMessage("Note count", downCount);
     bool first = true;
@@ -129,7 +147,6 @@ public:
       printNote(screen, lastMidi);
     }
   }
-#endif
 
 };
 
@@ -6,7 +6,7 @@
 
 #define OCTAVELEN 12
 
-const char *noteNames[OCTAVELEN] = {
+static const char *noteNames[OCTAVELEN] = {
   "C",
   "C#",
   "D",
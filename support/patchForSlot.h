@@ -5,7 +5,7 @@
 
 // Parameters are passed out (TOP ROW THEN BOTTOM ROW) horizontally
 // But we want them to be passed out in 2x2 blocks of 4, left to right
-PatchParameterId patchForSlot(int i) {
+static PatchParameterId patchForSlot(int i) {
 	return PatchParameterId((i & 1) | ( (i & 2) << 2 ) | ( (i & 12) >> 1 ));
 }
 
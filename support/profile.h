@@ -0,0 +1,99 @@
+#ifndef __support_profile_hpp__
+#define __support_profile_hpp__
+
+// Scoped timers for hot sections of a patch.
+//
+//   PROFILE_SECTION(clickTrack)              // Once, at file scope
+//   ...
+//   { PROFILE_SCOPE(clickTrack); ... }       // Times everything to the end of the block
+//
+// In MagusSim the time comes from the TSC (or steady_clock off x86), and every section
+// shows up in the --bench report. On the device it comes from the Cortex-M DWT cycle
+// counter, and only if PATCH_PROFILE is defined before including this file; otherwise the
+// macros compile to nothing. Either way PROFILE_MEAN(name) is the mean ticks per call,
+// which a patch can put on the screen or send out through a parameter.
+// Sections are shared globals without locking. The simulator's --sweep runs a patch on many
+// threads at once, so its worker threads don't record into them.
+// License https://creativecommons.org/publicdomain/zero/1.0/
+
+#include <stdint.h>
+
+#if defined(OWL_SIMULATOR) || defined(PATCH_PROFILE)
+#define PROFILE_ENABLED 1
+#endif
+
+#ifdef OWL_SIMULATOR
+
+// The simulator's fake API defines SimProfileSection and a tick source, and keeps a list to report
+typedef SimProfileSection ProfileSection;
+static inline uint32_t profileNow() { return (uint32_t)_simProfileNow(); }
+#define PROFILE_RECORDING _simProfiling
+
+struct ProfileRegistration {
+  ProfileRegistration(ProfileSection *section) { _simProfileRegister(section); }
+};
+#define PROFILE_SECTION(name) \
+  static ProfileSection profile_##name = {#name, 0, 0, 0, 0}; \
+  static ProfileRegistration profileRegistration_##name(&profile_##name);
+
+#elif defined(PATCH_PROFILE)
+
+struct ProfileSection {
+  const char *name;
+  uint64_t ticks;    // Total
+  uint32_t calls;
+  uint32_t maxTicks;
+  ProfileSection *next; // Unused on device
+};
+
+// Data Watchpoint and Trace unit, present on Cortex-M3 and up
+#define PROFILE_DEMCR      (*(volatile uint32_t *)0xE000EDFC)
+#define PROFILE_DWT_CTRL   (*(volatile uint32_t *)0xE0001000)
+#define PROFILE_DWT_CYCCNT (*(volatile uint32_t *)0xE0001004)
+
+static inline uint32_t profileNow() {
+  if (!(PROFILE_DWT_CTRL & 1)) { // Firmware may not have started the counter
+    PROFILE_DEMCR |= 1 << 24;   // TRCENA
+    PROFILE_DWT_CYCCNT = 0;
+    PROFILE_DWT_CTRL |= 1;      // CYCCNTENA
+  }
+  return PROFILE_DWT_CYCCNT;
+}
+#define PROFILE_RECORDING 1
+#define PROFILE_SECTION(name) \
+  static ProfileSection profile_##name = {#name, 0, 0, 0, 0};
+
+#endif
+
+#ifdef PROFILE_ENABLED
+
+class ProfileScope {
+  ProfileSection &section;
+  uint32_t start;
+public:
+  ProfileScope(ProfileSection &_section) : section(_section), start(profileNow()) {}
+  ~ProfileScope() {
+    if (!PROFILE_RECORDING)
+      return;
+    uint32_t ticks = profileNow() - start; // Unsigned, so counter wraparound cancels out
+    section.ticks += ticks;
+    section.calls++;
+    if (ticks > section.maxTicks)
+      section.maxTicks = ticks;
+  }
+};
+
+#define PROFILE_SCOPE(name) ProfileScope profileScope_##name(profile_##name)
+#define PROFILE_MEAN(name) (profile_##name.calls ? (uint32_t)(profile_##name.ticks / profile_##name.calls) : 0)
+#define PROFILE_RESET(name) do { profile_##name.ticks = 0; profile_##name.calls = 0; profile_##name.maxTicks = 0; } while (0)
+
+#else
+
+#define PROFILE_SECTION(name)
+#define PROFILE_SCOPE(name)
+#define PROFILE_MEAN(name) 0
+#define PROFILE_RESET(name) do {} while (0)
+
+#endif
+
+#endif // __support_profile_hpp__